@@ -0,0 +1,535 @@
+/*
+ * This file is part of the sigrok-cli project.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#ifdef HAVE_GLOB_H
+#include <glob.h>
+#endif
+#ifdef G_OS_UNIX
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+#include "sigrok-cli.h"
+
+/*
+ * Batch processing of multiple input files. Each file is processed like
+ * a single -i invocation would, the output goes to a file name which is
+ * derived from a template. Files get handed out to worker processes one
+ * at a time. Each worker keeps its library contexts, and the decoders
+ * which were loaded before, across the files which it processes. Worker
+ * processes also isolate failures, a broken file only fails that file.
+ */
+
+struct batch_report {
+	gint64 pid;
+	guint32 index;
+	gint32 status;
+	gint64 usec;
+};
+
+struct batch_worker {
+	gint64 pid;
+	int task_fd;
+	gint64 index;
+};
+
+static gchar *output_template;
+
+static gboolean is_pattern(const char *arg)
+{
+	return strpbrk(arg, "*?[") && !g_file_test(arg, G_FILE_TEST_EXISTS);
+}
+
+static gboolean add_pattern(GPtrArray *files, const char *pattern)
+{
+#ifdef HAVE_GLOB_H
+	glob_t gl;
+	size_t idx;
+	int ret;
+
+	ret = glob(pattern, 0, NULL, &gl);
+	if (ret == GLOB_NOMATCH) {
+		g_critical("No input files match '%s'.", pattern);
+		return FALSE;
+	}
+	if (ret != 0) {
+		g_critical("Cannot expand input file pattern '%s'.", pattern);
+		return FALSE;
+	}
+	for (idx = 0; idx < gl.gl_pathc; idx++)
+		g_ptr_array_add(files, g_strdup(gl.gl_pathv[idx]));
+	globfree(&gl);
+
+	return TRUE;
+#else
+	g_ptr_array_add(files, g_strdup(pattern));
+
+	return TRUE;
+#endif
+}
+
+/* Read input file names from a list file, one per line. */
+static gboolean add_list_file(GPtrArray *files, const char *listfile)
+{
+	GError *error;
+	gchar *content, **lines, *line;
+	size_t idx;
+
+	error = NULL;
+	if (!g_file_get_contents(listfile, &content, NULL, &error)) {
+		g_critical("Cannot read input file list: %s.", error->message);
+		g_error_free(error);
+		return FALSE;
+	}
+	lines = g_strsplit(content, "\n", 0);
+	g_free(content);
+	for (idx = 0; lines[idx]; idx++) {
+		line = g_strstrip(lines[idx]);
+		if (!*line || *line == '#')
+			continue;
+		g_ptr_array_add(files, g_strdup(line));
+	}
+	g_strfreev(lines);
+
+	return TRUE;
+}
+
+/*
+ * Expand the -i arguments into the list of input files. Arguments which
+ * start with '@' name a list file. Arguments which contain wildcards and
+ * don't name an existing file are glob patterns (for shells which don't
+ * expand them, or when the expansion would exceed command line limits).
+ */
+gchar **batch_expand_inputs(gchar **args)
+{
+	GPtrArray *files;
+	size_t idx;
+	gboolean ok;
+
+	files = g_ptr_array_new();
+	ok = TRUE;
+	for (idx = 0; ok && args[idx]; idx++) {
+		if (args[idx][0] == '@' && args[idx][1])
+			ok = add_list_file(files, &args[idx][1]);
+		else if (is_pattern(args[idx]))
+			ok = add_pattern(files, args[idx]);
+		else
+			g_ptr_array_add(files, g_strdup(args[idx]));
+	}
+	if (ok && !files->len) {
+		g_critical("No input files specified.");
+		ok = FALSE;
+	}
+	for (idx = 0; ok && files->len > 1 && idx < files->len; idx++) {
+		if (strcmp(g_ptr_array_index(files, idx), "-") == 0) {
+			g_critical("Input from stdin can't be combined with "
+				"other input files.");
+			ok = FALSE;
+		}
+	}
+	g_ptr_array_add(files, NULL);
+	if (!ok) {
+		g_strfreev((gchar **)g_ptr_array_free(files, FALSE));
+		return NULL;
+	}
+
+	return (gchar **)g_ptr_array_free(files, FALSE);
+}
+
+/*
+ * Derive an output file name from the template. Supported placeholders:
+ * %f (input file's basename without extension), %b (basename), %d
+ * (input file's directory), %n (input file's number), %% (literal %).
+ */
+static gchar *batch_output_name(const char *input, size_t index)
+{
+	GString *name;
+	const char *p;
+	gchar *base, *dir, *ext;
+
+	base = g_path_get_basename(input);
+	dir = g_path_get_dirname(input);
+	name = g_string_sized_new(256);
+	for (p = output_template; *p; p++) {
+		if (*p != '%' || !p[1]) {
+			g_string_append_c(name, *p);
+			continue;
+		}
+		switch (*++p) {
+		case 'f':
+			ext = strrchr(base, '.');
+			if (ext && ext != base)
+				g_string_append_len(name, base, ext - base);
+			else
+				g_string_append(name, base);
+			break;
+		case 'b':
+			g_string_append(name, base);
+			break;
+		case 'd':
+			g_string_append(name, dir);
+			break;
+		case 'n':
+			g_string_append_printf(name, "%zu", index + 1);
+			break;
+		default:
+			g_string_append_c(name, *p);
+			break;
+		}
+	}
+	g_free(base);
+	g_free(dir);
+
+	return g_string_free(name, FALSE);
+}
+
+static gboolean batch_process_file(size_t index, gboolean do_props,
+	gboolean is_first)
+{
+	gchar *outname;
+
+	opt_input_file = opt_input_files[index];
+
+#ifdef HAVE_SRD
+	if (opt_pds && !is_first && pd_session_renew() != 0)
+		return FALSE;
+#else
+	(void)is_first;
+#endif
+
+	outname = NULL;
+	if (output_template) {
+		outname = batch_output_name(opt_input_file, index);
+		if (opt_pds || do_props) {
+			/* Decoder output and properties go to stdout. */
+			if (!freopen(outname, "wb", stdout)) {
+				g_warning("Cannot write to '%s': %s.", outname,
+					g_strerror(errno));
+				g_free(outname);
+				return FALSE;
+			}
+		} else {
+			g_free(opt_output_file);
+			opt_output_file = g_strdup(outname);
+		}
+	}
+
+	if (do_props && !output_template)
+		printf("%s:\n", opt_input_file);
+	load_input_file(do_props);
+#ifdef HAVE_SRD
+	if (opt_pds)
+		show_pd_close();
+#endif
+	fflush(stdout);
+	g_free(outname);
+
+	return TRUE;
+}
+
+static void batch_progress(size_t done, size_t total, size_t index,
+	gboolean ok, gint64 usec)
+{
+	if (ok) {
+		g_message("cli: [%zu/%zu] %s: done in %.2f s.", done, total,
+			opt_input_files[index], usec / 1e6);
+	} else {
+		g_warning("[%zu/%zu] %s: failed.", done, total,
+			opt_input_files[index]);
+	}
+}
+
+#ifdef G_OS_UNIX
+static void batch_worker_run(int task_fd, int report_fd, gboolean do_props)
+{
+	struct batch_report report;
+	guint32 index;
+	gboolean is_first;
+	gint64 start;
+
+	is_first = TRUE;
+	while (read(task_fd, &index, sizeof(index)) == sizeof(index)) {
+		start = g_get_monotonic_time();
+		memset(&report, 0, sizeof(report));
+		report.pid = getpid();
+		report.index = index;
+		report.status = batch_process_file(index, do_props, is_first) ? 0 : 1;
+		report.usec = g_get_monotonic_time() - start;
+		is_first = FALSE;
+		if (write(report_fd, &report, sizeof(report)) != sizeof(report))
+			break;
+	}
+	close(task_fd);
+	close(report_fd);
+}
+
+static gboolean batch_worker_spawn(struct batch_worker *workers,
+	size_t count, size_t slot, int report_fds[2], gboolean do_props)
+{
+	int task_fds[2];
+	pid_t pid;
+	size_t idx;
+
+	if (pipe(task_fds) < 0) {
+		g_warning("Cannot create worker pipe: %s.", g_strerror(errno));
+		return FALSE;
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+	pid = fork();
+	if (pid < 0) {
+		g_warning("Cannot create worker process: %s.", g_strerror(errno));
+		close(task_fds[0]);
+		close(task_fds[1]);
+		return FALSE;
+	}
+	if (pid == 0) {
+		/* Only keep the worker's own ends of the pipes. */
+		for (idx = 0; idx < count; idx++) {
+			if (workers[idx].pid > 0)
+				close(workers[idx].task_fd);
+		}
+		close(task_fds[1]);
+		close(report_fds[0]);
+		batch_worker_run(task_fds[0], report_fds[1], do_props);
+		exit(0);
+	}
+
+	close(task_fds[0]);
+	workers[slot].pid = pid;
+	workers[slot].task_fd = task_fds[1];
+	workers[slot].index = -1;
+
+	return TRUE;
+}
+
+static struct batch_worker *batch_worker_find(struct batch_worker *workers,
+	size_t count, gint64 pid)
+{
+	size_t idx;
+
+	for (idx = 0; idx < count; idx++) {
+		if (workers[idx].pid == pid)
+			return &workers[idx];
+	}
+
+	return NULL;
+}
+
+/* Collect the reports which the workers sent. */
+static void batch_collect(struct batch_worker *workers, size_t count,
+	int report_fd, int timeout, size_t total, size_t *done, size_t *failed)
+{
+	struct batch_worker *w;
+	struct batch_report report;
+	struct pollfd pfd;
+
+	pfd.fd = report_fd;
+	pfd.events = POLLIN;
+	while (poll(&pfd, 1, timeout) > 0) {
+		if (read(report_fd, &report, sizeof(report)) != sizeof(report))
+			break;
+		w = batch_worker_find(workers, count, report.pid);
+		if (w)
+			w->index = -1;
+		(*done)++;
+		if (report.status)
+			(*failed)++;
+		batch_progress(*done, total, report.index, !report.status,
+			report.usec);
+		timeout = 0;
+	}
+}
+
+/*
+ * Hand out the input files to worker processes, and collect their
+ * reports. Workers which died get replaced while files are pending.
+ * Returns the number of failed files.
+ */
+static size_t batch_run_workers(size_t total, gboolean do_props)
+{
+	struct batch_worker *workers, *w;
+	int report_fds[2], status;
+	size_t count, idx, next, done, failed;
+	guint32 index;
+	pid_t pid;
+
+	if (pipe(report_fds) < 0) {
+		g_critical("Cannot create report pipe: %s.", g_strerror(errno));
+		return total;
+	}
+	/* A worker which died must not take the parent with it. */
+	signal(SIGPIPE, SIG_IGN);
+
+	count = MIN((size_t)opt_jobs, total);
+	workers = g_malloc0(count * sizeof(*workers));
+	for (idx = 0; idx < count; idx++) {
+		if (!batch_worker_spawn(workers, count, idx, report_fds, do_props))
+			workers[idx].pid = -1;
+	}
+
+	next = done = failed = 0;
+	while (done < total) {
+		/* Assign pending files to idle workers. */
+		for (idx = 0; idx < count; idx++) {
+			w = &workers[idx];
+			if (w->pid <= 0 || w->index >= 0 || next >= total)
+				continue;
+			index = next;
+			if (write(w->task_fd, &index, sizeof(index)) != sizeof(index))
+				continue;
+			w->index = index;
+			next++;
+		}
+
+		batch_collect(workers, count, report_fds[0], 100, total,
+			&done, &failed);
+
+		/*
+		 * A worker which died fails the file it was working on. Its
+		 * last report may still be in the pipe though.
+		 */
+		while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+			w = batch_worker_find(workers, count, pid);
+			if (!w)
+				continue;
+			batch_collect(workers, count, report_fds[0], 0, total,
+				&done, &failed);
+			close(w->task_fd);
+			w->pid = 0;
+			if (w->index >= 0) {
+				done++;
+				failed++;
+				batch_progress(done, total, w->index, FALSE, 0);
+				w->index = -1;
+			}
+		}
+
+		/* Replace workers while files are pending. */
+		for (idx = 0; idx < count && next < total; idx++) {
+			if (workers[idx].pid == 0)
+				batch_worker_spawn(workers, count, idx,
+					report_fds, do_props);
+		}
+		for (idx = 0; idx < count; idx++) {
+			if (workers[idx].pid > 0)
+				break;
+		}
+		if (idx == count && done < total) {
+			g_critical("No worker processes left.");
+			failed += total - done;
+			break;
+		}
+	}
+
+	/* Workers terminate when their task pipe gets closed. */
+	for (idx = 0; idx < count; idx++) {
+		if (workers[idx].pid <= 0)
+			continue;
+		close(workers[idx].task_fd);
+		waitpid(workers[idx].pid, &status, 0);
+	}
+	close(report_fds[0]);
+	close(report_fds[1]);
+	g_free(workers);
+
+	return failed;
+}
+#endif
+
+#ifndef G_OS_UNIX
+/* Process the input files one after another, in this process. */
+static size_t batch_run_serial(size_t total, gboolean do_props)
+{
+	size_t idx, failed;
+	gint64 start;
+	gboolean ok;
+
+	failed = 0;
+	for (idx = 0; idx < total; idx++) {
+		start = g_get_monotonic_time();
+		ok = batch_process_file(idx, do_props, idx == 0);
+		if (!ok)
+			failed++;
+		batch_progress(idx + 1, total, idx, ok,
+			g_get_monotonic_time() - start);
+	}
+
+	return failed;
+}
+#endif
+
+void batch_run(gboolean do_props)
+{
+	GStatBuf st;
+	size_t total, idx, failed;
+	uint64_t bytes;
+	gint64 start;
+	double secs;
+
+	total = g_strv_length(opt_input_files);
+
+	output_template = opt_output_file;
+	opt_output_file = NULL;
+	if (output_template && !strchr(output_template, '%')) {
+		g_critical("The output file name needs a placeholder "
+			"(like %%f) for multiple input files.");
+		return;
+	}
+	if (!output_template && opt_jobs > 1 && !do_props) {
+		g_critical("Parallel batch processing needs an output file "
+			"name template (-o).");
+		return;
+	}
+	if (do_props && !output_template)
+		opt_jobs = 1;
+
+	bytes = 0;
+	for (idx = 0; idx < total; idx++) {
+		if (g_stat(opt_input_files[idx], &st) == 0)
+			bytes += st.st_size;
+	}
+
+	start = g_get_monotonic_time();
+#ifdef G_OS_UNIX
+	failed = batch_run_workers(total, do_props);
+#else
+	failed = batch_run_serial(total, do_props);
+#endif
+	secs = (g_get_monotonic_time() - start) / 1e6;
+	if (secs <= 0)
+		secs = 1e-6;
+
+	g_printerr("Processed %zu files (%zu failed), %.1f MB in %.2f s: "
+		"%.1f MB/s, %.2f files/s.\n", total, failed, bytes / 1e6,
+		secs, bytes / 1e6 / secs, total / secs);
+
+	opt_output_file = output_template;
+	output_template = NULL;
+}
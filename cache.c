@@ -0,0 +1,785 @@
+/*
+ * This file is part of the sigrok-cli project.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include "sigrok-cli.h"
+
+/*
+ * Cache files live in the user's cache directory. Each file is named by
+ * its kind and a key, which is derived from the input file's identity
+ * (path, size, modification time) and the options which affect the
+ * cached content.
+ */
+
+static gchar *cache_dir(void)
+{
+	gchar *dir;
+
+	dir = g_build_filename(g_get_user_cache_dir(), "sigrok-cli", NULL);
+	if (g_mkdir_with_parents(dir, 0755) != 0) {
+		g_debug("cli: Cannot create cache directory %s.", dir);
+		g_free(dir);
+		return NULL;
+	}
+
+	return dir;
+}
+
+gchar *cache_path(const char *kind, const char *key)
+{
+	gchar *dir, *name, *path;
+
+	if (!(dir = cache_dir()))
+		return NULL;
+	name = g_strdup_printf("%s-%s", kind, key);
+	path = g_build_filename(dir, name, NULL);
+	g_free(name);
+	g_free(dir);
+
+	return path;
+}
+
+/* Derive a key from a file's identity, and additional parameters. */
+gchar *cache_file_key(const char *path, const char *params)
+{
+	GChecksum *sum;
+	GStatBuf st;
+	gchar *abs_path, *cwd, *ident, *key;
+
+	if (g_stat(path, &st) != 0)
+		return NULL;
+	if (g_path_is_absolute(path)) {
+		abs_path = g_strdup(path);
+	} else {
+		cwd = g_get_current_dir();
+		abs_path = g_build_filename(cwd, path, NULL);
+		g_free(cwd);
+	}
+	ident = g_strdup_printf("%s\n%" PRIu64 "\n%" PRId64 "\n%s",
+		abs_path, (uint64_t)st.st_size, (int64_t)st.st_mtime,
+		params ? params : "");
+
+	sum = g_checksum_new(G_CHECKSUM_SHA256);
+	g_checksum_update(sum, (const guchar *)ident, -1);
+	key = g_strdup(g_checksum_get_string(sum));
+	g_checksum_free(sum);
+	g_free(ident);
+	g_free(abs_path);
+
+	return key;
+}
+
+/*
+ * Converted input data (--cache). Slow input formats (like text) get
+ * converted once, the datafeed packets which the input module sent are
+ * stored in a native binary form. Later runs map the cache file, and
+ * send packets which refer to the mapping's content.
+ *
+ * The file starts with a magic string and a version, followed by a
+ * sequence of records. Every record has a header (type, and length of
+ * the payload) and is padded to a multiple of 8 bytes. The values are
+ * in the host's byte order, caches are not portable. The first record
+ * describes the device's channels, an END record completes the file.
+ * Incomplete files are never visible under their final name.
+ *
+ * The same records can be kept in memory, to pass on the packets which
+ * an input module sent in one thread to the session in another.
+ */
+#define INPUT_CACHE_MAGIC	"sigrok-cli cache"
+#define INPUT_CACHE_VERSION	1
+#define INPUT_CACHE_ALIGN	8
+
+enum input_cache_type {
+	CACHE_DEVICE = 1,
+	CACHE_SAMPLERATE,
+	CACHE_LOGIC,
+	CACHE_ANALOG,
+	CACHE_TRIGGER,
+	CACHE_FRAME_BEGIN,
+	CACHE_FRAME_END,
+	CACHE_END,
+};
+
+struct cache_file_header {
+	char magic[16];
+	uint32_t version;
+	uint32_t reserved;
+};
+
+struct cache_record {
+	uint32_t type;
+	uint32_t reserved;
+	uint64_t length;
+};
+
+struct cache_channel {
+	int32_t index;
+	int32_t type;
+	uint32_t name_len;
+	uint32_t reserved;
+	/* Followed by the name, padded. */
+};
+
+struct cache_logic {
+	uint32_t unitsize;
+	uint32_t reserved;
+	uint64_t length;
+	/* Followed by the sample data. */
+};
+
+struct cache_analog {
+	uint32_t num_samples;
+	uint32_t num_channels;
+	int32_t mq;
+	int32_t unit;
+	uint64_t mqflags;
+	int64_t scale_p;
+	uint64_t scale_q;
+	int64_t offset_p;
+	uint64_t offset_q;
+	uint8_t unitsize;
+	uint8_t is_signed;
+	uint8_t is_float;
+	uint8_t is_bigendian;
+	int8_t digits;
+	uint8_t is_digits_decimal;
+	int8_t spec_digits;
+	uint8_t reserved;
+	/* Followed by the channel indices (int32, padded), and the data. */
+};
+
+struct input_cache {
+	gchar *path;
+	gchar *tmp_path;
+	FILE *file;
+	GByteArray *buf;
+	gboolean failed;
+	gboolean have_device;
+};
+
+static size_t cache_pad(size_t len)
+{
+	return (INPUT_CACHE_ALIGN - len % INPUT_CACHE_ALIGN) % INPUT_CACHE_ALIGN;
+}
+
+static void input_cache_put(struct input_cache *ic, const void *data,
+	size_t len)
+{
+	if (!len || ic->failed)
+		return;
+
+	if (ic->buf)
+		g_byte_array_append(ic->buf, data, len);
+	else if (fwrite(data, len, 1, ic->file) != 1)
+		ic->failed = TRUE;
+}
+
+/* Write a record, its payload is given in parts. */
+static void input_cache_write(struct input_cache *ic, uint32_t type,
+	const void **parts, const size_t *lens, size_t count)
+{
+	static const uint8_t zeroes[INPUT_CACHE_ALIGN];
+	struct cache_record rec;
+	size_t idx;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.type = type;
+	for (idx = 0; idx < count; idx++)
+		rec.length += lens[idx] + cache_pad(lens[idx]);
+	input_cache_put(ic, &rec, sizeof(rec));
+	for (idx = 0; idx < count; idx++) {
+		input_cache_put(ic, parts[idx], lens[idx]);
+		input_cache_put(ic, zeroes, cache_pad(lens[idx]));
+	}
+}
+
+static void input_cache_write_device(struct input_cache *ic,
+	const struct sr_dev_inst *sdi)
+{
+	struct cache_channel *cc;
+	const struct sr_channel *ch;
+	GByteArray *buf;
+	GSList *l;
+	const void *parts[1];
+	size_t lens[1], len;
+	static const uint8_t zeroes[INPUT_CACHE_ALIGN];
+
+	buf = g_byte_array_new();
+	for (l = sr_dev_inst_channels_get(sdi); l; l = l->next) {
+		ch = l->data;
+		len = buf->len;
+		g_byte_array_set_size(buf, len + sizeof(*cc));
+		cc = (struct cache_channel *)&buf->data[len];
+		memset(cc, 0, sizeof(*cc));
+		cc->index = ch->index;
+		cc->type = ch->type;
+		cc->name_len = strlen(ch->name);
+		g_byte_array_append(buf, (const guint8 *)ch->name, strlen(ch->name));
+		g_byte_array_append(buf, zeroes, cache_pad(strlen(ch->name)));
+	}
+	parts[0] = buf->data;
+	lens[0] = buf->len;
+	input_cache_write(ic, CACHE_DEVICE, parts, lens, 1);
+	g_byte_array_free(buf, TRUE);
+	ic->have_device = TRUE;
+}
+
+static void input_cache_write_analog(struct input_cache *ic,
+	const struct sr_datafeed_analog *analog)
+{
+	struct cache_analog ca;
+	const struct sr_channel *ch;
+	int32_t *indices;
+	GSList *l;
+	const void *parts[3];
+	size_t lens[3], idx;
+
+	memset(&ca, 0, sizeof(ca));
+	ca.num_samples = analog->num_samples;
+	ca.num_channels = g_slist_length(analog->meaning->channels);
+	ca.mq = analog->meaning->mq;
+	ca.unit = analog->meaning->unit;
+	ca.mqflags = analog->meaning->mqflags;
+	ca.scale_p = analog->encoding->scale.p;
+	ca.scale_q = analog->encoding->scale.q;
+	ca.offset_p = analog->encoding->offset.p;
+	ca.offset_q = analog->encoding->offset.q;
+	ca.unitsize = analog->encoding->unitsize;
+	ca.is_signed = analog->encoding->is_signed;
+	ca.is_float = analog->encoding->is_float;
+	ca.is_bigendian = analog->encoding->is_bigendian;
+	ca.digits = analog->encoding->digits;
+	ca.is_digits_decimal = analog->encoding->is_digits_decimal;
+	ca.spec_digits = analog->spec ? analog->spec->spec_digits : 0;
+
+	indices = g_malloc0((ca.num_channels + 1) * sizeof(*indices));
+	for (l = analog->meaning->channels, idx = 0; l; l = l->next, idx++) {
+		ch = l->data;
+		indices[idx] = ch->index;
+	}
+
+	parts[0] = &ca;
+	lens[0] = sizeof(ca);
+	parts[1] = indices;
+	lens[1] = ca.num_channels * sizeof(*indices);
+	parts[2] = analog->data;
+	lens[2] = (size_t)ca.num_samples * ca.unitsize * MAX(ca.num_channels, 1);
+	input_cache_write(ic, CACHE_ANALOG, parts, lens, 3);
+	g_free(indices);
+}
+
+/* Datafeed callback which records the packets. */
+void input_cache_packet(const struct sr_dev_inst *sdi,
+	const struct sr_datafeed_packet *packet, void *cb_data)
+{
+	struct input_cache *ic;
+	const struct sr_datafeed_meta *meta;
+	const struct sr_datafeed_logic *logic;
+	const struct sr_config *src;
+	struct cache_logic cl;
+	uint64_t samplerate;
+	GSList *l;
+	const void *parts[2];
+	size_t lens[2];
+
+	ic = cb_data;
+	if (ic->failed)
+		return;
+	if (!ic->have_device && packet->type != SR_DF_HEADER)
+		input_cache_write_device(ic, sdi);
+
+	switch (packet->type) {
+	case SR_DF_HEADER:
+		if (!ic->have_device)
+			input_cache_write_device(ic, sdi);
+		break;
+	case SR_DF_META:
+		meta = packet->payload;
+		for (l = meta->config; l; l = l->next) {
+			src = l->data;
+			if (src->key != SR_CONF_SAMPLERATE)
+				continue;
+			samplerate = g_variant_get_uint64(src->data);
+			parts[0] = &samplerate;
+			lens[0] = sizeof(samplerate);
+			input_cache_write(ic, CACHE_SAMPLERATE, parts, lens, 1);
+		}
+		break;
+	case SR_DF_LOGIC:
+		logic = packet->payload;
+		memset(&cl, 0, sizeof(cl));
+		cl.unitsize = logic->unitsize;
+		cl.length = logic->length;
+		parts[0] = &cl;
+		lens[0] = sizeof(cl);
+		parts[1] = logic->data;
+		lens[1] = logic->length;
+		input_cache_write(ic, CACHE_LOGIC, parts, lens, 2);
+		break;
+	case SR_DF_ANALOG:
+		input_cache_write_analog(ic, packet->payload);
+		break;
+	case SR_DF_TRIGGER:
+		input_cache_write(ic, CACHE_TRIGGER, NULL, NULL, 0);
+		break;
+	case SR_DF_FRAME_BEGIN:
+		input_cache_write(ic, CACHE_FRAME_BEGIN, NULL, NULL, 0);
+		break;
+	case SR_DF_FRAME_END:
+		input_cache_write(ic, CACHE_FRAME_END, NULL, NULL, 0);
+		break;
+	default:
+		/* The END record gets written when the input is complete. */
+		break;
+	}
+}
+
+struct input_cache *input_cache_new(const char *key)
+{
+	struct input_cache *ic;
+	struct cache_file_header hdr;
+	gchar *path;
+
+	if (!(path = cache_path("input", key)))
+		return NULL;
+	ic = g_malloc0(sizeof(*ic));
+	ic->path = path;
+	ic->tmp_path = g_strdup_printf("%s.%d.tmp", path, (int)getpid());
+	if (!(ic->file = g_fopen(ic->tmp_path, "wb"))) {
+		g_debug("cli: Cannot create cache file %s.", ic->tmp_path);
+		g_free(ic->tmp_path);
+		g_free(ic->path);
+		g_free(ic);
+		return NULL;
+	}
+	setvbuf(ic->file, NULL, _IOFBF, 1024 * 1024);
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, INPUT_CACHE_MAGIC, sizeof(hdr.magic));
+	hdr.version = INPUT_CACHE_VERSION;
+	if (fwrite(&hdr, sizeof(hdr), 1, ic->file) != 1)
+		ic->failed = TRUE;
+
+	return ic;
+}
+
+/* Keep the records in memory, see input_cache_take_buffer(). */
+struct input_cache *input_cache_new_buffer(void)
+{
+	struct input_cache *ic;
+
+	ic = g_malloc0(sizeof(*ic));
+	ic->buf = g_byte_array_new();
+
+	return ic;
+}
+
+/*
+ * Get the records which were kept in memory, for cache_replay_buffer().
+ * Releases the input cache.
+ */
+GByteArray *input_cache_take_buffer(struct input_cache *ic)
+{
+	GByteArray *buf;
+
+	if (ic->have_device)
+		input_cache_write(ic, CACHE_END, NULL, NULL, 0);
+	buf = ic->buf;
+	g_free(ic);
+
+	return buf;
+}
+
+/*
+ * Store records which were kept in memory. Their END record is skipped,
+ * as are DEVICE records after the first.
+ */
+void input_cache_append(struct input_cache *ic, const GByteArray *records)
+{
+	const struct cache_record *rec;
+	size_t pos, len;
+
+	for (pos = 0; pos + sizeof(*rec) <= records->len; pos += len) {
+		rec = (const struct cache_record *)&records->data[pos];
+		len = sizeof(*rec) + rec->length;
+		if (rec->type == CACHE_END)
+			break;
+		if (rec->type == CACHE_DEVICE) {
+			if (ic->have_device)
+				continue;
+			ic->have_device = TRUE;
+		}
+		input_cache_put(ic, rec, len);
+	}
+}
+
+/*
+ * Finish the cache file. Only caches of complete input become visible,
+ * the input may have been read partially (sample range, properties).
+ */
+void input_cache_close(struct input_cache *ic, gboolean complete)
+{
+	if (!ic)
+		return;
+
+	if (complete && ic->have_device)
+		input_cache_write(ic, CACHE_END, NULL, NULL, 0);
+	if (fclose(ic->file) != 0)
+		ic->failed = TRUE;
+	if (complete && ic->have_device && !ic->failed
+			&& g_rename(ic->tmp_path, ic->path) == 0) {
+		g_debug("cli: Stored converted input in %s.", ic->path);
+	} else {
+		if (complete)
+			g_debug("cli: Cannot store converted input.");
+		g_unlink(ic->tmp_path);
+	}
+	g_free(ic->tmp_path);
+	g_free(ic->path);
+	g_free(ic);
+}
+
+struct cache_replay {
+	const uint8_t *pos;
+	const uint8_t *end;
+	struct sr_dev_inst *sdi;
+	struct sr_channel **channels;
+	size_t num_channels;
+	uint64_t samplerate;
+};
+
+/* Get the next record, returns its type, or 0 at malformed content. */
+static uint32_t cache_replay_next(struct cache_replay *cr,
+	const uint8_t **payload, uint64_t *length)
+{
+	const struct cache_record *rec;
+
+	if ((size_t)(cr->end - cr->pos) < sizeof(*rec))
+		return 0;
+	rec = (const struct cache_record *)cr->pos;
+	if (rec->length > (uint64_t)(cr->end - cr->pos) - sizeof(*rec))
+		return 0;
+	*payload = cr->pos + sizeof(*rec);
+	*length = rec->length;
+	cr->pos += sizeof(*rec) + rec->length;
+
+	return rec->type;
+}
+
+static gboolean cache_replay_device(struct cache_replay *cr,
+	const uint8_t *payload, uint64_t length)
+{
+	const struct cache_channel *cc;
+	const uint8_t *pos, *end;
+	struct sr_channel *ch;
+	gchar *name;
+	GSList *l;
+	int max_index;
+
+	cr->sdi = sr_dev_inst_user_new("sigrok-cli", "cache", NULL);
+	pos = payload;
+	end = payload + length;
+	max_index = -1;
+	while (pos + sizeof(*cc) <= end) {
+		cc = (const struct cache_channel *)pos;
+		pos += sizeof(*cc);
+		if (cc->index < 0 || cc->name_len > (size_t)(end - pos))
+			return FALSE;
+		name = g_strndup((const char *)pos, cc->name_len);
+		sr_dev_inst_channel_add(cr->sdi, cc->index, cc->type, name);
+		g_free(name);
+		max_index = MAX(max_index, cc->index);
+		pos += cc->name_len + cache_pad(cc->name_len);
+	}
+
+	/* Lookup of channels by index, for analog packets. */
+	cr->num_channels = max_index + 1;
+	cr->channels = g_malloc0(cr->num_channels * sizeof(*cr->channels));
+	for (l = sr_dev_inst_channels_get(cr->sdi); l; l = l->next) {
+		ch = l->data;
+		if (ch->index >= 0 && (size_t)ch->index < cr->num_channels)
+			cr->channels[ch->index] = ch;
+	}
+
+	return TRUE;
+}
+
+static gboolean cache_replay_analog(struct cache_replay *cr,
+	const uint8_t *payload, uint64_t length, struct df_arg_desc *df_arg)
+{
+	const struct cache_analog *ca;
+	const int32_t *indices;
+	struct sr_datafeed_packet packet;
+	struct sr_datafeed_analog analog;
+	struct sr_analog_encoding encoding;
+	struct sr_analog_meaning meaning;
+	struct sr_analog_spec spec;
+	uint64_t head_len, data_len;
+	uint32_t idx;
+
+	if (length < sizeof(*ca))
+		return FALSE;
+	ca = (const struct cache_analog *)payload;
+	head_len = sizeof(*ca) + ca->num_channels * sizeof(*indices);
+	head_len += cache_pad(head_len);
+	data_len = (uint64_t)ca->num_samples * ca->unitsize
+		* MAX(ca->num_channels, 1);
+	if (head_len + data_len > length)
+		return FALSE;
+	indices = (const int32_t *)(payload + sizeof(*ca));
+
+	memset(&meaning, 0, sizeof(meaning));
+	meaning.mq = ca->mq;
+	meaning.unit = ca->unit;
+	meaning.mqflags = ca->mqflags;
+	for (idx = 0; idx < ca->num_channels; idx++) {
+		if (indices[idx] < 0 || (size_t)indices[idx] >= cr->num_channels
+				|| !cr->channels[indices[idx]]) {
+			g_slist_free(meaning.channels);
+			return FALSE;
+		}
+		meaning.channels = g_slist_append(meaning.channels,
+			cr->channels[indices[idx]]);
+	}
+	memset(&encoding, 0, sizeof(encoding));
+	encoding.unitsize = ca->unitsize;
+	encoding.is_signed = ca->is_signed;
+	encoding.is_float = ca->is_float;
+	encoding.is_bigendian = ca->is_bigendian;
+	encoding.digits = ca->digits;
+	encoding.is_digits_decimal = ca->is_digits_decimal;
+	encoding.scale.p = ca->scale_p;
+	encoding.scale.q = ca->scale_q;
+	encoding.offset.p = ca->offset_p;
+	encoding.offset.q = ca->offset_q;
+	memset(&spec, 0, sizeof(spec));
+	spec.spec_digits = ca->spec_digits;
+
+	memset(&analog, 0, sizeof(analog));
+	analog.data = (void *)(payload + head_len);
+	analog.num_samples = ca->num_samples;
+	analog.encoding = &encoding;
+	analog.meaning = &meaning;
+	analog.spec = &spec;
+	packet.type = SR_DF_ANALOG;
+	packet.payload = &analog;
+	datafeed_in(cr->sdi, &packet, df_arg);
+	g_slist_free(meaning.channels);
+
+	return TRUE;
+}
+
+static void cache_replay_send(struct cache_replay *cr, uint16_t type,
+	const void *payload, struct df_arg_desc *df_arg)
+{
+	struct sr_datafeed_packet packet;
+
+	packet.type = type;
+	packet.payload = payload;
+	datafeed_in(cr->sdi, &packet, df_arg);
+}
+
+/* Create the device from the first DEVICE record, and start the feed. */
+static int cache_replay_start(struct cache_replay *cr,
+	const uint8_t *payload, uint64_t length, struct df_arg_desc *df_arg)
+{
+	struct sr_datafeed_header header;
+	int64_t now;
+
+	if (!cache_replay_device(cr, payload, length))
+		return SR_ERR_DATA;
+	if (select_channels(cr->sdi) != SR_OK)
+		return SR_ERR;
+
+	memset(&header, 0, sizeof(header));
+	header.feed_version = 1;
+	now = g_get_real_time();
+	header.starttime.tv_sec = now / G_USEC_PER_SEC;
+	header.starttime.tv_usec = now % G_USEC_PER_SEC;
+	cache_replay_send(cr, SR_DF_HEADER, &header, df_arg);
+
+	return SR_OK;
+}
+
+/*
+ * Send the packets of the records up to the END record. Later DEVICE
+ * records are skipped, as are repeated samplerates.
+ */
+static gboolean cache_replay_records(struct cache_replay *cr,
+	struct df_arg_desc *df_arg)
+{
+	struct sr_datafeed_meta meta;
+	struct sr_datafeed_logic logic;
+	struct sr_config src;
+	const struct cache_logic *cl;
+	const uint8_t *payload;
+	uint64_t length, samplerate;
+	uint32_t type;
+	gboolean ok;
+
+	ok = TRUE;
+	while (ok && !sample_window_done()) {
+		type = cache_replay_next(cr, &payload, &length);
+		if (type == CACHE_END)
+			break;
+		if (type != CACHE_DEVICE && !cr->sdi)
+			return FALSE;
+		switch (type) {
+		case CACHE_DEVICE:
+			if (!cr->sdi)
+				ok = cache_replay_start(cr, payload, length,
+					df_arg) == SR_OK;
+			break;
+		case CACHE_SAMPLERATE:
+			ok = length >= sizeof(uint64_t);
+			if (!ok)
+				break;
+			samplerate = *(const uint64_t *)payload;
+			if (samplerate == cr->samplerate)
+				break;
+			cr->samplerate = samplerate;
+			src.key = SR_CONF_SAMPLERATE;
+			src.data = g_variant_ref_sink(g_variant_new_uint64(samplerate));
+			meta.config = g_slist_append(NULL, &src);
+			cache_replay_send(cr, SR_DF_META, &meta, df_arg);
+			g_slist_free(meta.config);
+			g_variant_unref(src.data);
+			break;
+		case CACHE_LOGIC:
+			cl = (const struct cache_logic *)payload;
+			ok = length >= sizeof(*cl) && cl->unitsize
+				&& cl->length <= length - sizeof(*cl);
+			if (!ok)
+				break;
+			logic.unitsize = cl->unitsize;
+			logic.data = (void *)(payload + sizeof(*cl));
+			logic.length = cl->length;
+			cache_replay_send(cr, SR_DF_LOGIC, &logic, df_arg);
+			break;
+		case CACHE_ANALOG:
+			ok = cache_replay_analog(cr, payload, length, df_arg);
+			break;
+		case CACHE_TRIGGER:
+			cache_replay_send(cr, SR_DF_TRIGGER, NULL, df_arg);
+			break;
+		case CACHE_FRAME_BEGIN:
+			cache_replay_send(cr, SR_DF_FRAME_BEGIN, NULL, df_arg);
+			break;
+		case CACHE_FRAME_END:
+			cache_replay_send(cr, SR_DF_FRAME_END, NULL, df_arg);
+			break;
+		default:
+			ok = FALSE;
+			break;
+		}
+	}
+
+	return ok;
+}
+
+/*
+ * Replay converted input data from the cache. Returns SR_ERR_NA when
+ * there is no (usable) cache for the key.
+ */
+int input_cache_replay(const char *key, struct df_arg_desc *df_arg)
+{
+	GMappedFile *mf;
+	const struct cache_file_header *hdr;
+	struct cache_replay cr;
+	const uint8_t *payload;
+	uint64_t length;
+	gchar *path;
+	int ret;
+
+	if (!(path = cache_path("input", key)))
+		return SR_ERR_NA;
+	mf = g_mapped_file_new(path, FALSE, NULL);
+	g_free(path);
+	if (!mf)
+		return SR_ERR_NA;
+
+	memset(&cr, 0, sizeof(cr));
+	cr.pos = (const uint8_t *)g_mapped_file_get_contents(mf);
+	cr.end = cr.pos + g_mapped_file_get_length(mf);
+	hdr = (const struct cache_file_header *)cr.pos;
+	if ((size_t)(cr.end - cr.pos) < sizeof(*hdr)
+			|| memcmp(hdr->magic, INPUT_CACHE_MAGIC, sizeof(hdr->magic)) != 0
+			|| hdr->version != INPUT_CACHE_VERSION) {
+		g_mapped_file_unref(mf);
+		return SR_ERR_NA;
+	}
+	cr.pos += sizeof(*hdr);
+	if (cache_replay_next(&cr, &payload, &length) != CACHE_DEVICE
+			|| (ret = cache_replay_start(&cr, payload, length,
+			df_arg)) == SR_ERR_DATA) {
+		g_free(cr.channels);
+		g_mapped_file_unref(mf);
+		return SR_ERR_NA;
+	}
+	if (ret != SR_OK) {
+		g_free(cr.channels);
+		g_mapped_file_unref(mf);
+		return SR_ERR;
+	}
+	g_debug("cli: Replaying converted input from the cache.");
+
+	if (!cache_replay_records(&cr, df_arg))
+		g_warning("Cached input data is damaged, remove it from %s.",
+			g_get_user_cache_dir());
+	cache_replay_send(&cr, SR_DF_END, NULL, df_arg);
+
+	/* User device instances can't be freed by applications. */
+	g_free(cr.channels);
+	g_mapped_file_unref(mf);
+
+	return SR_OK;
+}
+
+/*
+ * Replay of records from memory buffers. The device gets created from
+ * the first buffer's DEVICE record, later buffers continue the feed.
+ */
+struct cache_replay *cache_replay_new(void)
+{
+	return g_malloc0(sizeof(struct cache_replay));
+}
+
+int cache_replay_buffer(struct cache_replay *cr, const GByteArray *records,
+	struct df_arg_desc *df_arg)
+{
+	cr->pos = records->data;
+	cr->end = records->data + records->len;
+
+	return cache_replay_records(cr, df_arg) ? SR_OK : SR_ERR_DATA;
+}
+
+/* Ends the feed when it was started, and releases the replay. */
+void cache_replay_finish(struct cache_replay *cr, struct df_arg_desc *df_arg)
+{
+	if (cr->sdi)
+		cache_replay_send(cr, SR_DF_END, NULL, df_arg);
+	g_free(cr->channels);
+	g_free(cr);
+}
@@ -28,8 +28,80 @@ static GHashTable *pd_ann_visible = NULL;
 static GHashTable *pd_meta_visible = NULL;
 static GHashTable *pd_binary_visible = NULL;
 static GHashTable *pd_channel_maps = NULL;
+/* All decoder instances, in the order of their creation. */
+static GSList *pd_insts = NULL;
+
+/*
+ * Visible annotation classes of a decoder, as a bitset. Also the row
+ * description of every class, which trace events use.
+ */
+struct pd_ann_filter {
+	gboolean all;
+	guint count;
+	const char **rows;
+	guint64 bits[];
+};
+
+/* Filters by decoder, and the one which was used last. */
+static GHashTable *pd_ann_filters = NULL;
+static const struct srd_decoder *pd_ann_last_dec = NULL;
+static const struct pd_ann_filter *pd_ann_last_filter = NULL;
 
 uint64_t pd_samplerate = 0;
+/* Absolute sample number of the first sample which decoders receive. */
+uint64_t pd_sample_offset = 0;
+/* Logic channels which are assigned to decoder inputs, by index. */
+uint64_t pd_input_mask = 0;
+/* Decoder inputs are assigned to channels past the first 64. */
+static gboolean pd_input_wide = FALSE;
+/* Channel setups of decoder instances, to be applied once all are known. */
+static GSList *pd_inst_channels = NULL;
+
+struct pd_inst_channel_setup {
+	struct srd_decoder_inst *di;
+	GHashTable *indices;
+};
+
+/*
+ * Decoders only get the logic channels which are assigned to their
+ * inputs, packed into the smallest unit size. A table per input byte
+ * has the gathered bits for each of the byte's values.
+ */
+static struct {
+	gboolean active;
+	int unitsize;
+	guint num_bytes;
+	guint bytes[8];
+	uint64_t lut[8][256];
+	uint8_t *buf;
+	size_t size;
+} gather;
+/* Only output which starts in this range of absolute samples is shown. */
+uint64_t pd_output_from = 0;
+uint64_t pd_output_to = UINT64_MAX;
+
+/*
+ * Idle run elision (--protocol-decoder-elide). The decoders' sample
+ * numbers are shifted by the count of removed samples, from the sample
+ * on where they were removed.
+ */
+struct pd_elide_shift {
+	uint64_t from;
+	uint64_t removed;
+};
+
+static struct {
+	uint64_t keep;
+	gboolean have_last;
+	uint64_t last;
+	uint64_t run;
+	uint64_t sent;
+	uint64_t removed;
+	GArray *shifts;
+	/* Counts from before the decoders were last reset. */
+	uint64_t prior_sent;
+	uint64_t prior_removed;
+} elide;
 
 extern struct srd_session *srd_sess;
 
@@ -128,6 +200,87 @@ static GHashTable *extract_channel_map(struct srd_decoder *dec, GHashTable *hash
 	return channel_map;
 }
 
+/*
+ * Translate the lists of visible annotation classes to bitsets, which
+ * get looked up by the decoder (not by its name) for every annotation.
+ */
+static void build_pd_ann_filters(void)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+	struct srd_decoder *dec;
+	struct srd_decoder_annotation_row *row;
+	struct pd_ann_filter *filter;
+	GSList *l, *lrow;
+	guint count, words, idx;
+	int ann_class;
+	char **ann_descr;
+
+	if (pd_ann_filters)
+		g_hash_table_destroy(pd_ann_filters);
+	pd_ann_filters = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+		NULL, g_free);
+	pd_ann_last_dec = NULL;
+	pd_ann_last_filter = NULL;
+
+	g_hash_table_iter_init(&iter, pd_ann_visible);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		if (!(dec = srd_decoder_get_by_id(key)))
+			continue;
+		count = g_slist_length(dec->annotations);
+		words = (count + 63) / 64;
+		filter = g_malloc0(sizeof(*filter)
+			+ words * sizeof(filter->bits[0])
+			+ count * sizeof(filter->rows[0]));
+		filter->count = count;
+		filter->rows = (const char **)&filter->bits[words];
+		for (l = value; l; l = l->next) {
+			ann_class = GPOINTER_TO_INT(l->data);
+			if (ann_class == -1)
+				filter->all = TRUE;
+			else if (ann_class >= 0 && (guint)ann_class < count)
+				filter->bits[ann_class / 64] |=
+					(guint64)1 << (ann_class % 64);
+		}
+		/* The first row with the class, or the class' description. */
+		for (lrow = dec->annotation_rows; lrow; lrow = lrow->next) {
+			row = lrow->data;
+			for (l = row->ann_classes; l; l = l->next) {
+				ann_class = GPOINTER_TO_INT(l->data);
+				if (ann_class >= 0 && (guint)ann_class < count
+						&& !filter->rows[ann_class])
+					filter->rows[ann_class] = row->desc;
+			}
+		}
+		for (idx = 0, l = dec->annotations; l; idx++, l = l->next) {
+			ann_descr = l->data;
+			if (!filter->rows[idx])
+				filter->rows[idx] = ann_descr[0];
+		}
+		g_hash_table_insert(pd_ann_filters, dec, filter);
+	}
+}
+
+static gboolean pd_ann_is_visible(const struct srd_decoder *dec, int ann_class)
+{
+	const struct pd_ann_filter *filter;
+
+	/* Consecutive annotations mostly come from the same decoder. */
+	if (dec != pd_ann_last_dec) {
+		pd_ann_last_dec = dec;
+		pd_ann_last_filter = g_hash_table_lookup(pd_ann_filters, dec);
+	}
+	filter = pd_ann_last_filter;
+	if (!filter)
+		return FALSE;
+	if (filter->all)
+		return TRUE;
+	if (ann_class < 0 || (guint)ann_class >= filter->count)
+		return FALSE;
+
+	return (filter->bits[ann_class / 64] >> (ann_class % 64)) & 1;
+}
+
 static int register_pd(char *opt_pds, char *opt_pd_annotations)
 {
 	int ret;
@@ -182,6 +335,7 @@ static int register_pd(char *opt_pds, char *opt_pd_annotations)
 			ret = 1;
 			break;
 		}
+		pd_insts = g_slist_append(pd_insts, di);
 
 		if (pdtok == pdtokens) {
 			/*
@@ -241,13 +395,23 @@ int register_pds(gchar **all_pds, char *opt_pd_annotations)
 	int ret;
 
 	ret = 0;
+	/* Start over when a previous decode session gets replaced. */
+	if (pd_ann_visible)
+		g_hash_table_destroy(pd_ann_visible);
+	if (pd_channel_maps)
+		g_hash_table_destroy(pd_channel_maps);
 	pd_ann_visible = g_hash_table_new_full(g_str_hash, g_str_equal,
 					       g_free, NULL);
 	pd_channel_maps = g_hash_table_new_full(g_str_hash,
 		g_str_equal, g_free, (GDestroyNotify)g_hash_table_destroy);
+	pd_input_mask = 0;
+	pd_input_wide = FALSE;
+	g_slist_free(pd_insts);
+	pd_insts = NULL;
 
 	for (int i = 0; all_pds[i]; i++)
 		ret += register_pd(all_pds[i], opt_pd_annotations);
+	build_pd_ann_filters();
 
 	return ret;
 }
@@ -273,6 +437,7 @@ static void map_pd_inst_channels(void *key, void *value, void *user_data)
 	const char *keyword;
 	GSList *l_pd, *l_pdo, *l_ch;
 	struct srd_channel *pdch;
+	struct pd_inst_channel_setup *setup;
 
 	channel_map = value;
 	channel_list = user_data;
@@ -397,29 +562,474 @@ static void map_pd_inst_channels(void *key, void *value, void *user_data)
 			g_printerr("cli: Target channel \"%s\" not enabled.\n",
 				   (char *)channel_target);
 
+		if (ch->index < 64)
+			pd_input_mask |= (uint64_t)1 << ch->index;
+		else
+			pd_input_wide = TRUE;
 		var = g_variant_new_int32(ch->index);
 		g_variant_ref_sink(var);
 		g_hash_table_insert(channel_indices, g_strdup(channel_id), var);
 	}
 
-	srd_inst_channel_set_all(di, channel_indices);
-	g_hash_table_destroy(channel_indices);
+	/* Gets applied when the channels of all decoders are known. */
+	setup = g_malloc(sizeof(*setup));
+	setup->di = di;
+	setup->indices = channel_indices;
+	pd_inst_channels = g_slist_append(pd_inst_channels, setup);
 }
 
-void map_pd_channels(struct sr_dev_inst *sdi)
+/*
+ * Prepare the gathering of the decoder input channels, when that makes
+ * the data smaller. A channel's position in the gathered data is the
+ * number of input channels with lower indices.
+ */
+static void setup_pd_gather(GSList *channels)
 {
-	GSList *channels;
+	struct sr_channel *ch;
+	GSList *l;
+	uint64_t mask;
+	int unitsize, max_index, count, pos, byte, value, bit;
+
+	g_free(gather.buf);
+	memset(&gather, 0, sizeof(gather));
+	if (!pd_input_mask || pd_input_wide)
+		return;
+
+	max_index = -1;
+	for (l = channels; l; l = l->next) {
+		ch = l->data;
+		if (ch->type == SR_CHANNEL_LOGIC)
+			max_index = MAX(max_index, ch->index);
+	}
+	unitsize = (max_index + 8) / 8;
+	for (count = 0, mask = pd_input_mask; mask; mask &= mask - 1)
+		count++;
+	if ((count + 7) / 8 >= unitsize)
+		return;
 
-	channels = sr_dev_inst_channels_get(sdi);
+	gather.active = TRUE;
+	gather.unitsize = (count + 7) / 8;
+	pos = 0;
+	for (byte = 0; byte < 8; byte++) {
+		mask = (pd_input_mask >> (8 * byte)) & 0xff;
+		if (!mask)
+			continue;
+		for (value = 0; value < 256; value++) {
+			for (bit = 0, count = 0; bit < 8; bit++) {
+				if (!(mask & (1 << bit)))
+					continue;
+				if (value & (1 << bit))
+					gather.lut[gather.num_bytes][value] |=
+						(uint64_t)1 << (pos + count);
+				count++;
+			}
+		}
+		gather.bytes[gather.num_bytes++] = byte;
+		pos += count;
+	}
+	g_debug("cli: Decoders get %d of %d bytes per sample.",
+		gather.unitsize, unitsize);
+}
+
+/* Channel indices in the gathered data. */
+static void gather_pd_channel_indices(GHashTable *indices)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+	GVariant *var;
+	uint64_t below;
+	int index, pos;
+
+	g_hash_table_iter_init(&iter, indices);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		index = g_variant_get_int32(value);
+		below = pd_input_mask & (((uint64_t)1 << index) - 1);
+		for (pos = 0; below; below &= below - 1)
+			pos++;
+		var = g_variant_new_int32(pos);
+		g_variant_ref_sink(var);
+		g_hash_table_iter_replace(&iter, var);
+	}
+}
+
+/*
+ * Gather the decoder input channels of logic data. Returns the gathered
+ * data, or NULL when the data lacks some of the channels.
+ */
+static const uint8_t *gather_pd_data(const uint8_t *data, uint64_t count,
+	int unitsize)
+{
+	const uint8_t *sample;
+	uint8_t *out;
+	uint64_t pos, value;
+	guint idx;
+
+	if ((int)gather.bytes[gather.num_bytes - 1] >= unitsize)
+		return NULL;
+	if (gather.size < count * gather.unitsize) {
+		gather.size = count * gather.unitsize;
+		gather.buf = g_realloc(gather.buf, gather.size);
+	}
+
+	sample = data;
+	out = gather.buf;
+	if (gather.num_bytes == 1 && gather.unitsize == 1) {
+		/* A single byte has all of the decoders' channels. */
+		sample += gather.bytes[0];
+		for (pos = 0; pos < count; pos++, sample += unitsize)
+			*out++ = gather.lut[0][*sample];
+		return gather.buf;
+	}
+	for (pos = 0; pos < count; pos++, sample += unitsize) {
+		value = 0;
+		for (idx = 0; idx < gather.num_bytes; idx++)
+			value |= gather.lut[idx][sample[gather.bytes[idx]]];
+		for (idx = 0; idx < (guint)gather.unitsize; idx++)
+			*out++ = value >> (8 * idx);
+	}
+
+	return gather.buf;
+}
+
+/*
+ * Apply the decoders' channel setup for a list of channels. Decoder
+ * worker processes, when running, get the list and do the setup.
+ */
+void map_pd_channel_list(GSList *channels)
+{
+	struct pd_inst_channel_setup *setup;
+	GSList *l;
 
 	if (pd_channel_maps) {
-		g_hash_table_foreach(pd_channel_maps, &map_pd_inst_channels,
-				     channels);
+		if (!pd_workers_channels(channels)) {
+			g_hash_table_foreach(pd_channel_maps,
+				&map_pd_inst_channels, channels);
+			setup_pd_gather(channels);
+		}
+		for (l = pd_inst_channels; l; l = l->next) {
+			setup = l->data;
+			if (gather.active)
+				gather_pd_channel_indices(setup->indices);
+			srd_inst_channel_set_all(setup->di, setup->indices);
+			g_hash_table_destroy(setup->indices);
+		}
+		g_slist_free_full(pd_inst_channels, g_free);
+		pd_inst_channels = NULL;
 		g_hash_table_destroy(pd_channel_maps);
 		pd_channel_maps = NULL;
 	}
 }
 
+void map_pd_channels(struct sr_dev_inst *sdi)
+{
+	map_pd_channel_list(sr_dev_inst_channels_get(sdi));
+}
+
+/* Get a sample's first (up to) 64 channels, in channel index order. */
+static uint64_t pd_sample_value(const uint8_t *p, int unitsize)
+{
+	uint64_t value;
+	int idx;
+
+	value = 0;
+	for (idx = 0; idx < unitsize && idx < 8; idx++)
+		value |= (uint64_t)p[idx] << (8 * idx);
+
+	return value;
+}
+
+/*
+ * Count the samples at the start of a buffer, which have the given
+ * value on the masked channels. Samples which evenly fill 64bit words
+ * get compared a word at a time.
+ */
+uint64_t pd_same_samples(const uint8_t *data, uint64_t count, int unitsize,
+	uint64_t mask, uint64_t value)
+{
+	uint64_t pos, word, pattern, wmask;
+	guint shift, per_word;
+
+	if (unitsize < 8)
+		mask &= ((uint64_t)1 << (8 * unitsize)) - 1;
+	value &= mask;
+
+	pos = 0;
+	if (unitsize == 1 || unitsize == 2 || unitsize == 4 || unitsize == 8) {
+		pattern = wmask = 0;
+		for (shift = 0; shift < 64; shift += 8 * unitsize) {
+			pattern |= value << shift;
+			wmask |= mask << shift;
+		}
+		per_word = 8 / unitsize;
+		while (pos + per_word <= count) {
+			memcpy(&word, &data[pos * unitsize], sizeof(word));
+			if ((GUINT64_FROM_LE(word) ^ pattern) & wmask)
+				break;
+			pos += per_word;
+		}
+	}
+	while (pos < count && (pd_sample_value(&data[pos * unitsize],
+			unitsize) & mask) == value)
+		pos++;
+
+	return pos;
+}
+
+/* Convert a sample number of the decoders to an absolute one. */
+uint64_t pd_abs_sample(uint64_t snum)
+{
+	const struct pd_elide_shift *shifts;
+	guint lo, hi, mid;
+
+	if (!elide.shifts || !elide.shifts->len)
+		return snum + pd_sample_offset;
+
+	/* Find the last shift which applies, mostly the latest one. */
+	shifts = (const struct pd_elide_shift *)elide.shifts->data;
+	lo = 0;
+	hi = elide.shifts->len;
+	if (snum >= shifts[hi - 1].from)
+		lo = hi - 1;
+	while (hi - lo > 1) {
+		mid = lo + (hi - lo) / 2;
+		if (snum >= shifts[mid].from)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	if (snum < shifts[lo].from)
+		return snum + pd_sample_offset;
+
+	return snum + shifts[lo].removed + pd_sample_offset;
+}
+
+/* Set up idle run elision for a new decode session. */
+static void pd_elide_reset(void)
+{
+	char *end;
+
+	if (!opt_pd_elide)
+		return;
+	if (!elide.keep) {
+		elide.keep = g_ascii_strtoull(opt_pd_elide, &end, 10);
+		if (end == opt_pd_elide || *end || !elide.keep)
+			g_critical("Invalid idle run length '%s'.", opt_pd_elide);
+	}
+	if (!elide.shifts)
+		elide.shifts = g_array_new(FALSE, FALSE,
+			sizeof(struct pd_elide_shift));
+	g_array_set_size(elide.shifts, 0);
+	elide.have_last = FALSE;
+	elide.run = 0;
+	elide.sent = 0;
+	elide.removed = 0;
+	elide.prior_sent = 0;
+	elide.prior_removed = 0;
+}
+
+/* The decoders count from zero again, keep the totals. */
+static void pd_elide_restart(void)
+{
+	if (!elide.keep)
+		return;
+	elide.prior_sent += elide.sent;
+	elide.prior_removed += elide.removed;
+	elide.sent = 0;
+	elide.removed = 0;
+	elide.have_last = FALSE;
+	elide.run = 0;
+	g_array_set_size(elide.shifts, 0);
+}
+
+/*
+ * Send logic data, with the idle runs shortened. Samples of a run of
+ * unchanged decoder inputs, which exceed the run length to keep, are
+ * not sent. The sample numbers which decoders see get shifted by the
+ * number of samples which were removed before them.
+ */
+static int pd_elide_send(const uint8_t *data, uint64_t len, int unitsize)
+{
+	struct pd_elide_shift *last;
+	struct pd_elide_shift shift;
+	uint64_t mask, count, pos, chunk, same, keep_to, drop;
+	int ret;
+
+	/* Gathered data only has the decoders' input channels. */
+	mask = gather.active ? UINT64_MAX : pd_input_mask;
+	if (unitsize < 8)
+		mask &= ((uint64_t)1 << (8 * unitsize)) - 1;
+	if (!mask)
+		mask = UINT64_MAX;
+	count = len / unitsize;
+	pos = chunk = 0;
+	while (pos < count) {
+		if (!elide.have_last || (pd_sample_value(&data[pos * unitsize],
+				unitsize) & mask) != elide.last) {
+			elide.last = pd_sample_value(&data[pos * unitsize],
+				unitsize) & mask;
+			elide.have_last = TRUE;
+			elide.run = 0;
+		}
+		same = pd_same_samples(&data[pos * unitsize], count - pos,
+			unitsize, mask, elide.last);
+		if (elide.run + same > elide.keep) {
+			keep_to = pos;
+			if (elide.run < elide.keep)
+				keep_to += elide.keep - elide.run;
+			drop = pos + same - keep_to;
+			if (keep_to > chunk) {
+				ret = srd_session_send(srd_sess, elide.sent,
+					elide.sent + keep_to - chunk,
+					&data[chunk * unitsize],
+					(keep_to - chunk) * unitsize, unitsize);
+				if (ret != SRD_OK)
+					return ret;
+				elide.sent += keep_to - chunk;
+			}
+			/* A run may continue in the next buffer. */
+			elide.removed += drop;
+			last = elide.shifts->len ? &g_array_index(elide.shifts,
+				struct pd_elide_shift, elide.shifts->len - 1) : NULL;
+			if (last && last->from == elide.sent) {
+				last->removed = elide.removed;
+			} else {
+				shift.from = elide.sent;
+				shift.removed = elide.removed;
+				g_array_append_val(elide.shifts, shift);
+			}
+			chunk = pos + same;
+		}
+		elide.run += same;
+		pos += same;
+	}
+	if (count > chunk) {
+		ret = srd_session_send(srd_sess, elide.sent,
+			elide.sent + count - chunk, &data[chunk * unitsize],
+			(count - chunk) * unitsize, unitsize);
+		if (ret != SRD_OK)
+			return ret;
+		elide.sent += count - chunk;
+	}
+
+	return SRD_OK;
+}
+
+/*
+ * Send logic data to the decode session, with only the decoders' input
+ * channels, and with idle runs shortened when that was requested.
+ */
+int pd_session_feed(uint64_t start_sample, uint64_t end_sample,
+	const uint8_t *data, uint64_t len, int unitsize)
+{
+	uint64_t count;
+
+	if (gather.active) {
+		count = len / unitsize;
+		if (!(data = gather_pd_data(data, count, unitsize))) {
+			g_critical("Logic data lacks decoder input channels.");
+			return SRD_ERR;
+		}
+		unitsize = gather.unitsize;
+		len = count * unitsize;
+	}
+	/* Channels past the first 64 are not checked for changes. */
+	if (elide.keep && unitsize <= 8)
+		return pd_elide_send(data, len, unitsize);
+
+	return srd_session_send(srd_sess, start_sample, end_sample,
+		data, len, unitsize);
+}
+
+int pd_session_samplerate(uint64_t samplerate)
+{
+	pd_samplerate = samplerate;
+	if (pd_workers_active())
+		return pd_workers_samplerate(samplerate);
+
+	return srd_session_metadata_set(srd_sess, SRD_CONF_SAMPLERATE,
+		g_variant_new_uint64(samplerate));
+}
+
+int pd_session_start(void)
+{
+	if (pd_workers_active())
+		return pd_workers_session_start();
+	/* Segments get decoded after all of the input was received. */
+	if (pd_split_active())
+		return SRD_OK;
+	pd_elide_reset();
+
+	return srd_session_start(srd_sess);
+}
+
+/*
+ * Have the decoders start over after a gap in the data, they count from
+ * zero again. The given number of samples (the data before the gap and
+ * the gap itself) is added to the sample numbers of their output.
+ */
+int pd_session_reset(uint64_t samples)
+{
+	int ret;
+
+	if (pd_workers_active())
+		ret = pd_workers_reset();
+	else
+		ret = srd_session_terminate_reset(srd_sess);
+	pd_sample_offset += samples;
+	pd_elide_restart();
+	pd_profile_session_reset();
+
+	return ret;
+}
+
+int pd_session_send(uint64_t start_sample, uint64_t end_sample,
+	const uint8_t *data, uint64_t len, int unitsize)
+{
+	int ret;
+
+	/* Also flush output of a time based policy, when there is little. */
+	output_flush_check();
+	if (pd_workers_active()) {
+		ret = pd_workers_send(start_sample, end_sample, data, len,
+			unitsize);
+		if (ret != SRD_OK)
+			pd_cache_discard();
+		return ret;
+	}
+	if (pd_split_active())
+		return pd_split_spool(start_sample, end_sample, data, len,
+			unitsize);
+
+	pd_profile_begin();
+	ret = pd_session_feed(start_sample, end_sample, data, len, unitsize);
+	pd_profile_end(end_sample - start_sample);
+	if (ret != SRD_OK)
+		pd_cache_discard();
+
+	return ret;
+}
+
+void pd_session_eof(void)
+{
+	if (pd_workers_active()) {
+		pd_workers_eof();
+		return;
+	}
+	if (pd_split_active()) {
+		pd_split_run();
+		return;
+	}
+#if defined HAVE_SRD_SESSION_SEND_EOF && HAVE_SRD_SESSION_SEND_EOF
+	pd_profile_begin();
+	(void)srd_session_send_eof(srd_sess);
+	pd_profile_end(0);
+#endif
+	if (elide.keep)
+		g_message("cli: Skipped %" PRIu64 " idle samples, decoders "
+			"received %" PRIu64 ".", elide.prior_removed + elide.removed,
+			elide.prior_sent + elide.sent);
+}
+
 int setup_pd_annotations(char *opt_pd_annotations)
 {
 	GSList *l, *l_ann;
@@ -515,6 +1125,7 @@ int setup_pd_annotations(char *opt_pd_annotations)
 		g_strfreev(keyval);
 	}
 	g_strfreev(pds);
+	build_pd_ann_filters();
 
 	return 0;
 }
@@ -524,6 +1135,8 @@ int setup_pd_meta(char *opt_pd_meta)
 	struct srd_decoder *dec;
 	char **pds, **pdtok;
 
+	if (pd_meta_visible)
+		g_hash_table_destroy(pd_meta_visible);
 	pd_meta_visible = g_hash_table_new_full(g_str_hash, g_int_equal,
 			g_free, NULL);
 	pds = g_strsplit(opt_pd_meta, ",", 0);
@@ -547,6 +1160,8 @@ int setup_pd_binary(char *opt_pd_binary)
 	int bin_class;
 	char **pds, **pdtok, **keyval, **bin_name;
 
+	if (pd_binary_visible)
+		g_hash_table_destroy(pd_binary_visible);
 	pd_binary_visible = g_hash_table_new_full(g_str_hash, g_int_equal,
 			g_free, NULL);
 	pds = g_strsplit(opt_pd_binary, ",", 0);
@@ -590,183 +1205,304 @@ int setup_pd_binary(char *opt_pd_binary)
 }
 
 /*
- * Balance JSON object and array parentheses, and separate array items.
- * Somewhat convoluted API to re-use the routine for individual items as
- * well as the surrounding array and object, including deferred start of
- * the output and late flush (and to keep the state strictly local to the
- * routine). Some additional complexity due to JSON's inability to handle
- * a trailing comma at the last item. Code phrased such that text literals
- * are kept in their order of appearance in the output (where possible).
+ * Decoder output goes to stdout, or (in decoder worker processes) to
+ * the process which merges the output of several decoder stacks. The
+ * start sample is absolute.
  */
-static void jsontrace_open_close(gboolean is_close_req,
-	gboolean open_item, gboolean close_item)
+static void pd_output(uint64_t start_sample, const void *data, size_t len)
 {
-	static gboolean is_file_open;
-	static gboolean is_item_open;
+	if (start_sample < pd_output_from || start_sample >= pd_output_to)
+		return;
+	if (pd_worker_output(start_sample, data, len))
+		return;
 
-	if (is_close_req && is_item_open)
-		close_item = TRUE;
+	output_write(data, len);
+}
 
-	/* Automatic file header, and array item separation. */
-	if (open_item) {
-		if (!is_file_open)
-			printf("{\"traceEvents\": [\n");
-		if (is_item_open) {
-			printf("}");
-			is_item_open = FALSE;
-		}
-		if (is_file_open) {
-			printf(",\n");
-		}
-		is_file_open = TRUE;
-	}
+/* The text output of an annotation or meta item, built in one buffer. */
+static GString *pd_output_line(void)
+{
+	static GString *line;
+
+	if (!line)
+		line = g_string_sized_new(128);
+	g_string_truncate(line, 0);
+
+	return line;
+}
 
-	/* Array item open/append/close. */
-	if (open_item) {
-		printf("{");
-		is_item_open = TRUE;
+/* Google Trace Events (JSON) output, the array gets opened on demand. */
+static gboolean jsontrace_is_open;
+static GString *jsontrace_buf;
+
+/*
+ * Convert a sample number to a timestamp in microseconds, with six
+ * decimals. Integer math keeps the precision for long captures. Sample
+ * numbers are taken as microseconds when the samplerate is unknown.
+ */
+static void jsontrace_ts(char *buf, size_t size, uint64_t snum)
+{
+	uint64_t rate, usec, rem, frac;
+
+	rate = pd_samplerate ? pd_samplerate : 1000000;
+	snum = pd_abs_sample(snum);
+	usec = snum / rate * 1000000;
+	rem = snum % rate * 1000000;
+	usec += rem / rate;
+	frac = (rem % rate * 1000000 + rate / 2) / rate;
+	if (frac == 1000000) {
+		usec++;
+		frac = 0;
 	}
-	if (!open_item && !close_item && !is_close_req) {
-		printf(", ");
-		is_item_open = TRUE;
+	snprintf(buf, size, "%" PRIu64 ".%06" PRIu64, usec, frac);
+}
+
+static void jsontrace_event(const char *ph, uint64_t snum,
+	const char *pid, const char *tid, const char *name)
+{
+	char ts[48];
+
+	jsontrace_ts(ts, sizeof(ts), snum);
+	g_string_append_printf(jsontrace_buf, "%s{\"ph\": \"%s\", \"ts\": %s, "
+		"\"pid\": \"%s\", \"tid\": \"%s\", \"name\": \"%s\"}",
+		jsontrace_is_open ? ",\n" : "{\"traceEvents\": [\n",
+		ph, ts, pid, tid, name);
+	jsontrace_is_open = TRUE;
+}
+
+/*
+ * Emit two Google Trace Events (JSON) for one PD annotation (ss, es),
+ * with a single write.
+ *
+ * Set the 'pid' (process ID) to the decoder name to group a decoder's
+ * annotations. Set the 'tid' (thread ID) to the annotation row's
+ * description. The 'ts' (timestamp) is in microseconds. Set 'name' to
+ * the longest annotation text.
+ */
+static void jsontrace_annotation(const char *row_text,
+	struct srd_proto_data_annotation *pda, struct srd_proto_data *pdata)
+{
+	if (!jsontrace_buf)
+		jsontrace_buf = g_string_sized_new(512);
+	g_string_truncate(jsontrace_buf, 0);
+	jsontrace_event("B", pdata->start_sample, pdata->pdo->proto_id,
+		row_text, pda->ann_text[0]);
+	jsontrace_event("E", pdata->end_sample, pdata->pdo->proto_id,
+		row_text, pda->ann_text[0]);
+	output_write(jsontrace_buf->str, jsontrace_buf->len);
+}
+
+static void jsontrace_close(void)
+{
+	if (jsontrace_is_open)
+		output_write("\n]}\n", 4);
+	jsontrace_is_open = FALSE;
+	output_flush();
+}
+
+/*
+ * Binary record output (--protocol-decoder-records). The stream starts
+ * with the magic "SRPDREC" and a version byte (1). Every record then
+ * has a 32bit length (of the type byte and the body), and a type byte.
+ * Numbers are little endian. Record types:
+ *
+ * 1 Decoder: instance number (16bit), annotation class count (16bit),
+ *   binary class count (16bit). Then NUL terminated strings: instance
+ *   ID, decoder ID, annotation class IDs, binary class IDs. Written for
+ *   all decoder instances before their output, numbers count from 0.
+ * 2 Annotation: start and end sample (64bit, absolute), instance number
+ *   (16bit), annotation class (16bit), text count (16bit), the length
+ *   of every text (16bit each), the texts without terminators.
+ * 3 Binary: start and end sample (64bit, absolute), instance number
+ *   (16bit), binary class (16bit), the decoder's data.
+ */
+enum {
+	RECORD_DECODER = 1,
+	RECORD_ANNOTATION,
+	RECORD_BINARY,
+};
+
+static gboolean records_started;
+static GByteArray *records_buf;
+/* Instance numbers (plus 1), by decoder instance. */
+static GHashTable *records_insts;
+static const struct srd_decoder_inst *records_last_di;
+static guint records_last_inst;
+
+static void records_put(GByteArray *buf, uint64_t value, guint size)
+{
+	uint8_t bytes[8];
+	guint idx;
+
+	for (idx = 0; idx < size; idx++)
+		bytes[idx] = value >> (8 * idx);
+	g_byte_array_append(buf, bytes, size);
+}
+
+static void records_put_string(GByteArray *buf, const char *text)
+{
+	g_byte_array_append(buf, (const guint8 *)text, strlen(text) + 1);
+}
+
+/* Start a record, the length gets filled in when it's complete. */
+static void records_begin(int type)
+{
+	if (!records_buf)
+		records_buf = g_byte_array_sized_new(1024);
+	g_byte_array_set_size(records_buf, 0);
+	records_put(records_buf, 0, 4);
+	records_put(records_buf, type, 1);
+}
+
+static void records_end(uint64_t payload_len)
+{
+	uint64_t len;
+	guint idx;
+
+	len = records_buf->len - 4 + payload_len;
+	for (idx = 0; idx < 4; idx++)
+		records_buf->data[idx] = len >> (8 * idx);
+}
+
+static void records_decoder(struct srd_decoder_inst *di)
+{
+	struct srd_decoder *dec;
+	GSList *l;
+	char **descr;
+	guint inst;
+
+	dec = di->decoder;
+	inst = g_hash_table_size(records_insts);
+	g_hash_table_insert(records_insts, di, GUINT_TO_POINTER(inst + 1));
+
+	records_begin(RECORD_DECODER);
+	records_put(records_buf, inst, 2);
+	records_put(records_buf, g_slist_length(dec->annotations), 2);
+	records_put(records_buf, g_slist_length(dec->binary), 2);
+	records_put_string(records_buf, di->inst_id);
+	records_put_string(records_buf, dec->id);
+	for (l = dec->annotations; l; l = l->next) {
+		descr = l->data;
+		records_put_string(records_buf, descr[0]);
 	}
-	if (close_item) {
-		printf("}");
-		is_item_open = FALSE;
+	for (l = dec->binary; l; l = l->next) {
+		descr = l->data;
+		records_put_string(records_buf, descr[0]);
 	}
+	records_end(0);
+	output_write(records_buf->data, records_buf->len);
+}
 
-	/* Automatic file footer on shutdown. */
-	if (is_close_req && is_file_open) {
-		printf("\n");
-		printf("]}\n");
-	}
-	if (is_close_req)
-		is_file_open = FALSE;
+/* Write the decoder tables of a (new) decode session. */
+static void records_prepare(void)
+{
+	static const char magic[] = "SRPDREC\001";
+	GSList *l;
 
-	/* Flush at end of lines, or end of file. */
-	if (close_item || is_close_req)
-		fflush(stdout);
+	if (!records_started)
+		output_write(magic, sizeof(magic) - 1);
+	records_started = TRUE;
+
+	if (records_insts)
+		g_hash_table_destroy(records_insts);
+	records_insts = g_hash_table_new(g_direct_hash, g_direct_equal);
+	records_last_di = NULL;
+	for (l = pd_insts; l; l = l->next)
+		records_decoder(l->data);
 }
 
-/* Convert uint64 sample number to double timestamp in microseconds. */
-static double jsontrace_ts_usec(uint64_t snum)
+static guint records_inst(const struct srd_decoder_inst *di)
 {
-	double ts_usec;
+	if (di != records_last_di) {
+		records_last_di = di;
+		records_last_inst = GPOINTER_TO_UINT(
+			g_hash_table_lookup(records_insts, di)) - 1;
+	}
 
-	ts_usec = snum;
-	ts_usec *= 1e6;
-	ts_usec /= pd_samplerate;
-	return ts_usec;
+	return records_last_inst;
 }
 
-/* Emit two Google Trace Events (JSON) for one PD annotation (ss, es). */
-static void jsontrace_annotation(struct srd_decoder *dec,
-	struct srd_proto_data_annotation *pda, struct srd_proto_data *pdata)
+/* Start a record which covers a span of samples. */
+static void records_begin_span(int type, struct srd_proto_data *pdata,
+	int class)
 {
-	char *row_text;
-	GSList *lrow, *lcls;
-	struct srd_decoder_annotation_row *row;
-	int cls;
-	char **ann_descr;
+	records_begin(type);
+	records_put(records_buf, pd_abs_sample(pdata->start_sample), 8);
+	records_put(records_buf, pd_abs_sample(pdata->end_sample), 8);
+	records_put(records_buf, records_inst(pdata->pdo->di), 2);
+	records_put(records_buf, class, 2);
+}
 
-	/*
-	 * Search for an annotation row for this index, or use the
-	 * annotation's descriptor.
-	 */
-	row_text = NULL;
-	if (dec->annotation_rows) {
-		for (lrow = dec->annotation_rows; lrow; lrow = lrow->next) {
-			row = lrow->data;
-			for (lcls = row->ann_classes; lcls; lcls = lcls->next) {
-				cls = GPOINTER_TO_INT(lcls->data);
-				if (cls == pda->ann_class) {
-					row_text = row->desc;
-					break;
-				}
-			}
-			if (row_text)
-				break;
-		}
+static void records_annotation(struct srd_proto_data *pdata,
+	struct srd_proto_data_annotation *pda)
+{
+	guint count, idx;
+	size_t len;
+
+	for (count = 0; pda->ann_text[count] && count < G_MAXUINT16; count++)
+		;
+	records_begin_span(RECORD_ANNOTATION, pdata, pda->ann_class);
+	records_put(records_buf, count, 2);
+	for (idx = 0; idx < count; idx++) {
+		len = MIN(strlen(pda->ann_text[idx]), G_MAXUINT16);
+		records_put(records_buf, len, 2);
 	}
-	if (!row_text) {
-		ann_descr = g_slist_nth_data(dec->annotations, pda->ann_class);
-		row_text = ann_descr[0];
+	for (idx = 0; idx < count; idx++) {
+		len = MIN(strlen(pda->ann_text[idx]), G_MAXUINT16);
+		g_byte_array_append(records_buf,
+			(const guint8 *)pda->ann_text[idx], len);
 	}
+	records_end(0);
+	pd_output(pd_abs_sample(pdata->start_sample),
+		records_buf->data, records_buf->len);
+}
 
-	/*
-	 * Emit two Google Trace Events for the start and end times.
-	 * Set the 'pid' (process ID) to the decoder name to group a
-	 * decoder's annotations. Set the 'tid' (thread ID) to the
-	 * annotation row's description. The 'ts' (timestamp) is in
-	 * microseconds. Set 'name' to the longest annotation text.
-	 *
-	 * BEWARE of the unfortunate JSON format limitation, which
-	 * clutters data output calls with format helper calls.
-	 * TODO Want to introduce a cJSON dependency to delegate the
-	 * construction of output text?
-	 */
-	jsontrace_open_close(FALSE, TRUE, FALSE);
-	printf("\"%s\": \"%s\"", "ph", "B");
-	jsontrace_open_close(FALSE, FALSE, FALSE);
-	printf("\"%s\": %lf", "ts", jsontrace_ts_usec(pdata->start_sample));
-	jsontrace_open_close(FALSE, FALSE, FALSE);
-	printf("\"%s\": \"%s\"", "pid", pdata->pdo->proto_id);
-	jsontrace_open_close(FALSE, FALSE, FALSE);
-	printf("\"%s\": \"%s\"", "tid", row_text);
-	jsontrace_open_close(FALSE, FALSE, FALSE);
-	printf("\"%s\": \"%s\"", "name", pda->ann_text[0]);
-
-	jsontrace_open_close(FALSE, TRUE, FALSE);
-	printf("\"%s\": \"%s\"", "ph", "E");
-	jsontrace_open_close(FALSE, FALSE, FALSE);
-	printf("\"%s\": %lf", "ts", jsontrace_ts_usec(pdata->end_sample));
-	jsontrace_open_close(FALSE, FALSE, FALSE);
-	printf("\"%s\": \"%s\"", "pid", pdata->pdo->proto_id);
-	jsontrace_open_close(FALSE, FALSE, FALSE);
-	printf("\"%s\": \"%s\"", "tid", row_text);
-	jsontrace_open_close(FALSE, FALSE, FALSE);
-	printf("\"%s\": \"%s\"", "name", pda->ann_text[0]);
-
-	jsontrace_open_close(FALSE, FALSE, TRUE);
+/* The decoder's data follows the record head, without a copy. */
+static void records_binary(struct srd_proto_data *pdata,
+	struct srd_proto_data_binary *pdb)
+{
+	records_begin_span(RECORD_BINARY, pdata, pdb->bin_class);
+	records_end(pdb->size);
+	pd_output(pd_abs_sample(pdata->start_sample),
+		records_buf->data, records_buf->len);
+	pd_output(pd_abs_sample(pdata->start_sample),
+		pdb->data, pdb->size);
 }
 
 void show_pd_annotations(struct srd_proto_data *pdata, void *cb_data)
 {
 	struct srd_decoder *dec;
 	struct srd_proto_data_annotation *pda;
-	GSList *ann_list, *l;
 	int i;
 	char **ann_descr;
-	gboolean show_ann, show_snum, show_class, show_quotes, show_abbrev;
+	gboolean show_snum, show_class, show_quotes, show_abbrev;
 	const char *quote;
+	GString *line;
 
 	(void)cb_data;
 
-	if (!pd_ann_visible)
-		return;
-
-	if (!g_hash_table_lookup_extended(pd_ann_visible, pdata->pdo->di->decoder->id,
-			NULL, (void **)&ann_list)) {
-		/* Not in the list of PDs whose annotations we're showing. */
+	if (!pd_ann_filters)
 		return;
-	}
 
+	/* Only the PDs and classes whose annotations we're showing. */
 	dec = pdata->pdo->di->decoder;
 	pda = pdata->data;
-	show_ann = FALSE;
-	for (l = ann_list; l; l = l->next) {
-		if (GPOINTER_TO_INT(l->data) == -1
-				|| GPOINTER_TO_INT(l->data) == pda->ann_class) {
-			show_ann = TRUE;
-			break;
-		}
+	if (!pd_ann_is_visible(dec, pda->ann_class))
+		return;
+
+	if (opt_pd_sqlite) {
+		pd_sqlite_annotation(pdata);
+		return;
 	}
-	if (!show_ann)
+	if (opt_pd_records) {
+		records_annotation(pdata, pda);
 		return;
+	}
 
 	/* Google Trace Events are rather special. Use a separate code path. */
 	if (opt_pd_jsontrace) {
-		jsontrace_annotation(dec, pda, pdata);
+		jsontrace_annotation(pd_ann_last_filter->rows[pda->ann_class],
+			pda, pdata);
 		return;
 	}
 
@@ -800,40 +1536,56 @@ void show_pd_annotations(struct srd_proto_data *pdata, void *cb_data)
 	 * Display the annotation's fields after the layout was
 	 * determined above.
 	 */
+	line = pd_output_line();
 	if (show_snum) {
-		printf("%" PRIu64 "-%" PRIu64 " ",
-			pdata->start_sample, pdata->end_sample);
+		g_string_append_printf(line, "%" PRIu64 "-%" PRIu64 " ",
+			pd_abs_sample(pdata->start_sample),
+			pd_abs_sample(pdata->end_sample));
 	}
-	printf("%s: ", pdata->pdo->proto_id);
+	g_string_append_printf(line, "%s: ", pdata->pdo->proto_id);
 	if (show_class) {
 		ann_descr = g_slist_nth_data(dec->annotations, pda->ann_class);
-		printf("%s: ", ann_descr[0]);
+		g_string_append_printf(line, "%s: ", ann_descr[0]);
 	}
 	quote = show_quotes ? "\"" : "";
-	printf("%s%s%s", quote, pda->ann_text[0], quote);
+	g_string_append_printf(line, "%s%s%s", quote, pda->ann_text[0], quote);
 	if (show_abbrev) {
 		for (i = 1; pda->ann_text[i]; i++)
-			printf(" %s%s%s", quote, pda->ann_text[i], quote);
+			g_string_append_printf(line, " %s%s%s",
+				quote, pda->ann_text[i], quote);
 	}
-	printf("\n");
-	fflush(stdout);
+	g_string_append_c(line, '\n');
+	pd_output(pd_abs_sample(pdata->start_sample),
+		line->str, line->len);
 }
 
 void show_pd_meta(struct srd_proto_data *pdata, void *cb_data)
 {
+	GString *line;
+
 	(void)cb_data;
 
-	if (!g_hash_table_lookup_extended(pd_meta_visible,
+	/* All meta output goes to a database, unless -M was given. */
+	if (pd_meta_visible && !g_hash_table_lookup_extended(pd_meta_visible,
 			pdata->pdo->di->decoder->id, NULL, NULL))
 		/* Not in the list of PDs whose meta output we're showing. */
 		return;
+	if (opt_pd_sqlite) {
+		pd_sqlite_meta(pdata);
+		return;
+	}
 
+	line = pd_output_line();
 	if (opt_pd_samplenum || opt_loglevel > SR_LOG_WARN)
-		printf("%"PRIu64"-%"PRIu64" ", pdata->start_sample, pdata->end_sample);
-	printf("%s: ", pdata->pdo->proto_id);
-	printf("%s: %s", pdata->pdo->meta_name, g_variant_print(pdata->data, FALSE));
-	printf("\n");
-	fflush(stdout);
+		g_string_append_printf(line, "%"PRIu64"-%"PRIu64" ",
+			pd_abs_sample(pdata->start_sample),
+			pd_abs_sample(pdata->end_sample));
+	g_string_append_printf(line, "%s: ", pdata->pdo->proto_id);
+	g_string_append_printf(line, "%s: ", pdata->pdo->meta_name);
+	g_variant_print_string(pdata->data, line, FALSE);
+	g_string_append_c(line, '\n');
+	pd_output(pd_abs_sample(pdata->start_sample),
+		line->str, line->len);
 }
 
 void show_pd_binary(struct srd_proto_data *pdata, void *cb_data)
@@ -844,31 +1596,50 @@ void show_pd_binary(struct srd_proto_data *pdata, void *cb_data)
 
 	(void)cb_data;
 
-	if (!g_hash_table_lookup_extended(pd_binary_visible,
-			pdata->pdo->di->decoder->id, NULL, (void **)&classp))
-		/* Not in the list of PDs whose meta output we're showing. */
-		return;
+	/* All binary output goes to a database, unless -B was given. */
+	classi = -1;
+	if (pd_binary_visible) {
+		if (!g_hash_table_lookup_extended(pd_binary_visible,
+				pdata->pdo->di->decoder->id, NULL, (void **)&classp))
+			/* Not in the list of PDs whose meta output we're showing. */
+			return;
+		classi = GPOINTER_TO_INT(classp);
+	}
 
-	classi = GPOINTER_TO_INT(classp);
 	pdb = pdata->data;
 	if (classi != -1 && classi != pdb->bin_class)
 		/* Not showing this binary class. */
 		return;
 
+	if (opt_pd_sqlite) {
+		pd_sqlite_binary(pdata);
+		return;
+	}
+	if (opt_pd_records) {
+		records_binary(pdata, pdb);
+		return;
+	}
+
 	/* Just send the binary output to stdout, no embellishments. */
-	fwrite(pdb->data, pdb->size, 1, stdout);
-	fflush(stdout);
+	pd_output(pd_abs_sample(pdata->start_sample),
+		pdb->data, pdb->size);
 }
 
 void show_pd_prepare(void)
 {
-	if (opt_pd_jsontrace)
-		jsontrace_open_close(TRUE, FALSE, FALSE);
+	jsontrace_is_open = FALSE;
+	if (opt_pd_records)
+		records_prepare();
+	if (opt_pd_sqlite)
+		pd_sqlite_open(opt_pd_sqlite);
 }
 
 void show_pd_close(void)
 {
 	if (opt_pd_jsontrace)
-		jsontrace_open_close(TRUE, FALSE, FALSE);
+		jsontrace_close();
+	pd_sqlite_close();
+	pd_cache_finish();
+	output_flush();
 }
 #endif
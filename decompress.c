@@ -0,0 +1,401 @@
+/*
+ * This file is part of the sigrok-cli project.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <glib.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_LZMA
+#include <lzma.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include "sigrok-cli.h"
+
+/*
+ * Compressed input files get identified by their magic bytes and their
+ * filename suffix, and are decompressed while they are read. Both must
+ * agree, raw captures may well start with a compression format's magic
+ * bytes. Which compression formats are supported depends on the
+ * libraries which were found at build time.
+ */
+
+#define INPUT_BUF_SIZE (256 * 1024)
+
+enum compression {
+	COMPRESSION_GZIP,
+	COMPRESSION_XZ,
+	COMPRESSION_ZSTD,
+};
+
+static const struct {
+	enum compression type;
+	const char *name;
+	const char *suffix;
+	size_t magic_len;
+	const uint8_t magic[6];
+	gboolean supported;
+} compressions[] = {
+	/* gzip: ID1, ID2, and CM (deflate). */
+	{ COMPRESSION_GZIP, "gzip", ".gz", 3, { 0x1f, 0x8b, 0x08, },
+#ifdef HAVE_ZLIB
+		TRUE },
+#else
+		FALSE },
+#endif
+	{ COMPRESSION_XZ, "xz", ".xz", 6, { 0xfd, '7', 'z', 'X', 'Z', 0x00, },
+#ifdef HAVE_LZMA
+		TRUE },
+#else
+		FALSE },
+#endif
+	{ COMPRESSION_ZSTD, "zstd", ".zst", 4, { 0x28, 0xb5, 0x2f, 0xfd, },
+#ifdef HAVE_ZSTD
+		TRUE },
+#else
+		FALSE },
+#endif
+};
+
+struct decompressor {
+	int fd;
+	enum compression type;
+	const char *name;
+	uint8_t *in_buf;
+	size_t in_pos;
+	size_t in_len;
+	gboolean in_eof;
+	/* A complete stream was decoded, nothing is pending. */
+	gboolean ended;
+	const char *error;
+#ifdef HAVE_ZLIB
+	z_stream gz;
+#endif
+#ifdef HAVE_LZMA
+	lzma_stream xz;
+#endif
+#ifdef HAVE_ZSTD
+	ZSTD_DStream *zstd;
+#endif
+};
+
+#ifdef HAVE_ZLIB
+static int gzip_init(struct decompressor *dc)
+{
+	/* Have zlib expect (and check) the gzip header and trailer. */
+	if (inflateInit2(&dc->gz, 16 + MAX_WBITS) != Z_OK)
+		return SR_ERR;
+
+	return SR_OK;
+}
+
+static int gzip_step(struct decompressor *dc, uint8_t *out, size_t count,
+	size_t *produced)
+{
+	int ret;
+
+	/* gzip files may consist of several members, one after another. */
+	if (dc->ended) {
+		if (dc->in_pos == dc->in_len)
+			return SR_OK;
+		inflateReset(&dc->gz);
+		dc->ended = FALSE;
+	}
+
+	dc->gz.next_in = &dc->in_buf[dc->in_pos];
+	dc->gz.avail_in = dc->in_len - dc->in_pos;
+	dc->gz.next_out = out;
+	dc->gz.avail_out = MIN(count, G_MAXUINT);
+	ret = inflate(&dc->gz, Z_NO_FLUSH);
+	dc->in_pos = dc->in_len - dc->gz.avail_in;
+	*produced = MIN(count, G_MAXUINT) - dc->gz.avail_out;
+	if (ret == Z_STREAM_END) {
+		dc->ended = TRUE;
+	} else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+		dc->error = dc->gz.msg ? dc->gz.msg : "corrupt data";
+		return SR_ERR;
+	}
+
+	return SR_OK;
+}
+#endif
+
+#ifdef HAVE_LZMA
+static int xz_init(struct decompressor *dc)
+{
+	lzma_stream init = LZMA_STREAM_INIT;
+
+	dc->xz = init;
+	if (lzma_stream_decoder(&dc->xz, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK)
+		return SR_ERR;
+
+	return SR_OK;
+}
+
+static int xz_step(struct decompressor *dc, uint8_t *out, size_t count,
+	size_t *produced)
+{
+	lzma_ret ret;
+
+	dc->xz.next_in = &dc->in_buf[dc->in_pos];
+	dc->xz.avail_in = dc->in_len - dc->in_pos;
+	dc->xz.next_out = out;
+	dc->xz.avail_out = count;
+	/* Concatenated streams only end when told there is no more input. */
+	ret = lzma_code(&dc->xz, dc->in_eof ? LZMA_FINISH : LZMA_RUN);
+	dc->in_pos = dc->in_len - dc->xz.avail_in;
+	*produced = count - dc->xz.avail_out;
+	if (ret == LZMA_STREAM_END) {
+		dc->ended = TRUE;
+	} else if (ret != LZMA_OK && ret != LZMA_BUF_ERROR) {
+		dc->error = ret == LZMA_MEM_ERROR ? "out of memory" : "corrupt data";
+		return SR_ERR;
+	}
+
+	return SR_OK;
+}
+#endif
+
+#ifdef HAVE_ZSTD
+static int zstd_init(struct decompressor *dc)
+{
+	if (!(dc->zstd = ZSTD_createDStream()))
+		return SR_ERR;
+	if (ZSTD_isError(ZSTD_initDStream(dc->zstd)))
+		return SR_ERR;
+
+	return SR_OK;
+}
+
+static int zstd_step(struct decompressor *dc, uint8_t *out, size_t count,
+	size_t *produced)
+{
+	ZSTD_inBuffer in;
+	ZSTD_outBuffer outbuf;
+	size_t ret;
+
+	in.src = dc->in_buf;
+	in.size = dc->in_len;
+	in.pos = dc->in_pos;
+	outbuf.dst = out;
+	outbuf.size = count;
+	outbuf.pos = 0;
+	/* Frames which follow each other get decoded as one stream. */
+	ret = ZSTD_decompressStream(dc->zstd, &outbuf, &in);
+	dc->in_pos = in.pos;
+	*produced = outbuf.pos;
+	if (ZSTD_isError(ret)) {
+		dc->error = ZSTD_getErrorName(ret);
+		return SR_ERR;
+	}
+	dc->ended = ret == 0;
+
+	return SR_OK;
+}
+#endif
+
+static int decompressor_step(struct decompressor *dc, uint8_t *out,
+	size_t count, size_t *produced)
+{
+	*produced = 0;
+	switch (dc->type) {
+#ifdef HAVE_ZLIB
+	case COMPRESSION_GZIP:
+		return gzip_step(dc, out, count, produced);
+#endif
+#ifdef HAVE_LZMA
+	case COMPRESSION_XZ:
+		return xz_step(dc, out, count, produced);
+#endif
+#ifdef HAVE_ZSTD
+	case COMPRESSION_ZSTD:
+		return zstd_step(dc, out, count, produced);
+#endif
+	default:
+		(void)out;
+		(void)count;
+		dc->error = "unsupported compression";
+		return SR_ERR;
+	}
+}
+
+static gboolean has_suffix(const char *path, const char *suffix)
+{
+	size_t path_len, suffix_len;
+
+	path_len = strlen(path);
+	suffix_len = strlen(suffix);
+	if (path_len < suffix_len)
+		return FALSE;
+
+	return g_ascii_strcasecmp(&path[path_len - suffix_len], suffix) == 0;
+}
+
+/*
+ * Check whether the file is compressed, and prepare its decompression
+ * when it is. The file offset is expected to be at the file's start,
+ * and remains there. Returns NULL for files which are not compressed
+ * (and for pipes), these get read as they are.
+ */
+struct decompressor *decompressor_open(int fd, const char *path)
+{
+	struct decompressor *dc;
+	uint8_t magic[6];
+	ssize_t len;
+	size_t idx;
+	int ret;
+
+	if (lseek(fd, 0, SEEK_CUR) != 0)
+		return NULL;
+	len = read(fd, magic, sizeof(magic));
+	if (lseek(fd, 0, SEEK_SET) != 0 || len <= 0)
+		return NULL;
+	for (idx = 0; idx < G_N_ELEMENTS(compressions); idx++) {
+		if ((size_t)len >= compressions[idx].magic_len
+				&& !memcmp(magic, compressions[idx].magic,
+				compressions[idx].magic_len)
+				&& has_suffix(path, compressions[idx].suffix))
+			break;
+	}
+	if (idx == G_N_ELEMENTS(compressions))
+		return NULL;
+	if (!compressions[idx].supported) {
+		g_warning("%s looks %s compressed, which is not supported "
+			"by this build. Reading it as it is.", path,
+			compressions[idx].name);
+		return NULL;
+	}
+
+	dc = g_malloc0(sizeof(*dc));
+	dc->fd = fd;
+	dc->type = compressions[idx].type;
+	dc->name = compressions[idx].name;
+	dc->in_buf = g_malloc(INPUT_BUF_SIZE);
+	switch (dc->type) {
+#ifdef HAVE_ZLIB
+	case COMPRESSION_GZIP:
+		ret = gzip_init(dc);
+		break;
+#endif
+#ifdef HAVE_LZMA
+	case COMPRESSION_XZ:
+		ret = xz_init(dc);
+		break;
+#endif
+#ifdef HAVE_ZSTD
+	case COMPRESSION_ZSTD:
+		ret = zstd_init(dc);
+		break;
+#endif
+	default:
+		ret = SR_ERR;
+		break;
+	}
+	if (ret != SR_OK) {
+		g_critical("Failed to set up %s decompression.", dc->name);
+		decompressor_free(dc);
+		return NULL;
+	}
+	g_debug("cli: Input file %s is %s compressed.", path, dc->name);
+
+	return dc;
+}
+
+/*
+ * Read up to 'count' bytes of decompressed data. Returns the number of
+ * bytes, which is less than 'count' only at the end of the data, or -1
+ * on errors (see decompressor_error()).
+ */
+gssize decompressor_read(struct decompressor *dc, void *buf, size_t count)
+{
+	size_t done, produced, in_pos;
+	ssize_t len;
+
+	done = 0;
+	while (done < count && !dc->error) {
+		if (dc->in_pos == dc->in_len && !dc->in_eof) {
+			len = read(dc->fd, dc->in_buf, INPUT_BUF_SIZE);
+			if (len < 0 && errno == EINTR)
+				continue;
+			if (len < 0) {
+				dc->error = g_strerror(errno);
+				break;
+			}
+			dc->in_pos = 0;
+			dc->in_len = len;
+			dc->in_eof = len == 0;
+		}
+		if (dc->ended && dc->in_eof && dc->in_pos == dc->in_len)
+			break;
+		in_pos = dc->in_pos;
+		if (decompressor_step(dc, (uint8_t *)buf + done,
+				count - done, &produced) != SR_OK)
+			break;
+		done += produced;
+		if (!produced && in_pos == dc->in_pos && dc->in_eof) {
+			/* No progress, and there is no more input. */
+			if (!dc->ended)
+				dc->error = "unexpected end of data";
+			break;
+		}
+	}
+	if (dc->error && !done)
+		return -1;
+
+	return done;
+}
+
+const char *decompressor_error(const struct decompressor *dc)
+{
+	return dc->error;
+}
+
+/* Releases the decompressor, the file descriptor remains open. */
+void decompressor_free(struct decompressor *dc)
+{
+	if (!dc)
+		return;
+
+	switch (dc->type) {
+#ifdef HAVE_ZLIB
+	case COMPRESSION_GZIP:
+		inflateEnd(&dc->gz);
+		break;
+#endif
+#ifdef HAVE_LZMA
+	case COMPRESSION_XZ:
+		lzma_end(&dc->xz);
+		break;
+#endif
+#ifdef HAVE_ZSTD
+	case COMPRESSION_ZSTD:
+		ZSTD_freeDStream(dc->zstd);
+		break;
+#endif
+	default:
+		break;
+	}
+	g_free(dc->in_buf);
+	g_free(dc);
+}
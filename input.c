@@ -17,20 +17,753 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+/* madvise() hints beyond POSIX are only visible with this. */
+#define _DEFAULT_SOURCE
+
 #include <config.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdio.h>
 #include <glib.h>
+#include <glib/gstdio.h>
+#ifdef G_OS_UNIX
+#include <poll.h>
+#include <signal.h>
+#endif
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
 #include "sigrok-cli.h"
 
+/*
+ * Input data is read in chunks which start small (quick format detection
+ * and early output), and grow up to a limit which depends on the input
+ * format (see input_chunk_size_max()).
+ */
+#define CHUNK_SIZE_MIN (64 * 1024)
+#define CHUNK_SIZE_TEXT (256 * 1024)
 #define CHUNK_SIZE (4 * 1024 * 1024)
+#define CHUNK_SIZE_BINARY (16 * 1024 * 1024)
+
+/* Files beyond this size should not evict the page cache's content. */
+#define HUGE_FILE_SIZE ((uint64_t)1024 * 1024 * 1024)
+
+/* Number of chunks which the reader thread keeps in flight. */
+#define READAHEAD_CHUNKS 2
+
+/*
+ * In streaming mode, format detection is tried after this much data
+ * was received, or when the producer pauses for this long.
+ */
+#define STREAM_SCAN_MIN (4 * 1024)
+#define STREAM_SCAN_WAIT_MS 200
+
+/* Interval of checks for growth, when following without inotify. */
+#define FOLLOW_POLL_MS 250
+
+struct input_chunk {
+	GString *buf;
+	GString view;
+	GString *data;
+	uint64_t offset;
+	size_t length;
+};
+
+/*
+ * Source of input file content. Regular files get memory mapped, and
+ * the input module receives views into the mapping, which saves the
+ * copy into an intermediate buffer. Pipes and stdin (and platforms
+ * without mmap(2)) use buffers which read(2) fills in.
+ *
+ * A reader thread runs ahead of the input module's parser. It either
+ * reads into the next free buffer, or faults in the pages of the next
+ * view into the mapping. Such that I/O and parsing can overlap.
+ *
+ * Compressed files are decompressed by the reader thread, the parser
+ * receives the decompressed data in buffers.
+ *
+ * In streaming mode (--stream on stdin) there is no reader thread, data
+ * gets passed to the parser as soon as it arrives, in pieces of any size.
+ *
+ * When following a file (--follow), the reader thread waits for the file
+ * to grow at its end, and passes on appended data as it is read.
+ */
+struct input_source {
+	int fd;
+	struct decompressor *dc;
+	gboolean stream;
+	const char *map;
+	size_t map_size;
+	size_t page_size;
+	uint64_t file_pos;
+	size_t chunk_size;
+	size_t chunk_size_max;
+	gboolean drop_behind;
+	gboolean follow;
+	uint64_t follow_timeout_ms;
+	gint64 follow_last_data;
+	int follow_notify_fd;
+	gboolean follow_gone;
+	struct input_chunk chunks[READAHEAD_CHUNKS];
+	struct input_chunk *current;
+	GAsyncQueue *free_chunks;
+	GAsyncQueue *full_chunks;
+	GThread *reader;
+	gint stop;
+	gboolean eof;
+	int read_errno;
+	gint64 parser_wait_us;
+	gint64 reader_wait_us;
+};
+
+/*
+ * Upper limit of the chunk size for an input module. Text formats are
+ * parsed line by line, their chunks should fit into the CPU's caches.
+ * Raw binary formats are converted in bulk, larger chunks help there.
+ */
+static size_t input_chunk_size_max(const struct sr_input *in)
+{
+	static const char *text_formats[] = {
+		"csv", "vcd", "logicport", NULL,
+	};
+	static const char *binary_formats[] = {
+		"binary", "raw_analog", "chronovu-la8", "trace32_ad", "wav",
+		NULL,
+	};
+	const char *id;
+	size_t idx;
+
+	id = sr_input_id_get(sr_input_module_get(in));
+	if (!id)
+		return CHUNK_SIZE;
+	for (idx = 0; text_formats[idx]; idx++) {
+		if (strcmp(id, text_formats[idx]) == 0)
+			return CHUNK_SIZE_TEXT;
+	}
+	for (idx = 0; binary_formats[idx]; idx++) {
+		if (strcmp(id, binary_formats[idx]) == 0)
+			return CHUNK_SIZE_BINARY;
+	}
+
+	return CHUNK_SIZE;
+}
+
+/* Tell the kernel how the file is going to be accessed. */
+static void input_source_advise(struct input_source *src, struct stat *st)
+{
+#ifdef HAVE_POSIX_FADVISE
+	(void)posix_fadvise(src->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	if ((uint64_t)st->st_size >= HUGE_FILE_SIZE) {
+		(void)posix_fadvise(src->fd, 0, 0, POSIX_FADV_NOREUSE);
+		src->drop_behind = TRUE;
+	}
+#else
+	(void)src;
+	(void)st;
+#endif
+}
+
+static void input_source_map(struct input_source *src, struct stat *st)
+{
+#ifdef HAVE_SYS_MMAN_H
+	void *map;
+
+	if (st->st_size <= 0 || (uint64_t)st->st_size > SIZE_MAX)
+		return;
+
+	map = mmap(NULL, st->st_size, PROT_READ, MAP_PRIVATE, src->fd, 0);
+	if (map == MAP_FAILED) {
+		g_debug("cli: Cannot map input file, using read(): %s.",
+			g_strerror(errno));
+		return;
+	}
+#ifdef HAVE_POSIX_MADVISE
+	(void)posix_madvise(map, st->st_size, POSIX_MADV_SEQUENTIAL);
+#endif
+#ifdef MADV_HUGEPAGE
+	(void)madvise(map, st->st_size, MADV_HUGEPAGE);
+#endif
+	src->map = map;
+	src->map_size = st->st_size;
+	src->page_size = sysconf(_SC_PAGESIZE);
+	g_debug("cli: Mapped %zu bytes of input file.", src->map_size);
+#else
+	(void)src;
+	(void)st;
+#endif
+}
+
+/*
+ * Drop a chunk's file range from the page cache after the parser is
+ * done with it. Only done for huge files, see input_source_advise().
+ */
+static void input_chunk_release(struct input_source *src,
+	struct input_chunk *chunk)
+{
+#ifdef HAVE_POSIX_FADVISE
+	uint64_t start;
+
+	if (!src->drop_behind || !chunk->length)
+		return;
+
+	start = chunk->offset;
+#if defined HAVE_SYS_MMAN_H && defined MADV_DONTNEED
+	/* Mapped pages stay in the page cache, unmap them first. */
+	if (src->map) {
+		start -= start % src->page_size;
+		(void)madvise((void *)&src->map[start],
+			chunk->offset + chunk->length - start, MADV_DONTNEED);
+	}
+#endif
+	(void)posix_fadvise(src->fd, start,
+		chunk->offset + chunk->length - start, POSIX_FADV_DONTNEED);
+	chunk->length = 0;
+#else
+	(void)src;
+	(void)chunk;
+#endif
+}
+
+#ifdef G_OS_UNIX
+/*
+ * A signal ends following. The handler sets the flag for the reader's
+ * loop, and wakes up the reader when it is waiting for more data.
+ */
+static volatile sig_atomic_t follow_stopped;
+static int follow_signal_pipe[2] = { -1, -1 };
+static struct sigaction follow_old_sigint, follow_old_sigterm;
+
+static void follow_signal_handler(int sig)
+{
+	(void)sig;
+
+	follow_stopped = 1;
+	if (write(follow_signal_pipe[1], "", 1) < 0)
+		return;
+}
+#endif
 
-static void load_input_file_module(struct df_arg_desc *df_arg)
+static void input_follow_init(struct input_source *src, gboolean is_stdin)
+{
+#ifdef G_OS_UNIX
+	struct sigaction sa;
+#endif
+
+	src->follow_notify_fd = -1;
+	if (!opt_follow || is_stdin || src->stream)
+		return;
+	if (src->dc) {
+		g_warning("Cannot follow compressed input files.");
+		return;
+	}
+	if (opt_follow_timeout) {
+		if (!(src->follow_timeout_ms = sr_parse_timestring(opt_follow_timeout)))
+			g_critical("Invalid follow timeout '%s'.", opt_follow_timeout);
+	}
+	src->follow = TRUE;
+	src->follow_last_data = g_get_monotonic_time();
+
+#ifdef HAVE_SYS_INOTIFY_H
+	src->follow_notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (src->follow_notify_fd >= 0 && inotify_add_watch(src->follow_notify_fd,
+			opt_input_file, IN_MODIFY | IN_DELETE_SELF | IN_MOVE_SELF) < 0) {
+		close(src->follow_notify_fd);
+		src->follow_notify_fd = -1;
+	}
+	if (src->follow_notify_fd < 0)
+		g_debug("cli: Cannot watch input file, polling: %s.",
+			g_strerror(errno));
+#endif
+
+#ifdef G_OS_UNIX
+	follow_stopped = 0;
+	if (pipe(follow_signal_pipe) < 0)
+		g_critical("Failed to create pipe: %s.", g_strerror(errno));
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = follow_signal_handler;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, &follow_old_sigint);
+	sigaction(SIGTERM, &sa, &follow_old_sigterm);
+#endif
+}
+
+static void input_follow_cleanup(struct input_source *src)
+{
+	if (!src->follow)
+		return;
+
+	if (src->follow_notify_fd >= 0)
+		close(src->follow_notify_fd);
+	src->follow_notify_fd = -1;
+#ifdef G_OS_UNIX
+	sigaction(SIGINT, &follow_old_sigint, NULL);
+	sigaction(SIGTERM, &follow_old_sigterm, NULL);
+	close(follow_signal_pipe[0]);
+	close(follow_signal_pipe[1]);
+	follow_signal_pipe[0] = follow_signal_pipe[1] = -1;
+#endif
+}
+
+/* Check whether a signal asked to stop following. */
+static gboolean input_follow_stopped(struct input_source *src)
+{
+#ifdef G_OS_UNIX
+	return src->follow && follow_stopped;
+#else
+	(void)src;
+
+	return FALSE;
+#endif
+}
+
+#ifdef HAVE_SYS_INOTIFY_H
+/* Consume the pending events, and check whether the file went away. */
+static void input_follow_drain(struct input_source *src)
+{
+	union {
+		struct inotify_event ev;
+		char buf[4096];
+	} events;
+	const struct inotify_event *ev;
+	ssize_t len, pos;
+
+	while ((len = read(src->follow_notify_fd, &events, sizeof(events))) > 0) {
+		for (pos = 0; pos < len; pos += sizeof(*ev) + ev->len) {
+			ev = (const struct inotify_event *)&events.buf[pos];
+			if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+				src->follow_gone = TRUE;
+		}
+	}
+}
+#endif
+
+/*
+ * Wait until the followed file grows. Returns FALSE when following
+ * ends: after a signal, when the file was removed or renamed, or when
+ * no data was appended for the idle timeout.
+ */
+static gboolean input_follow_wait(struct input_source *src)
+{
+	gint64 idle_ms;
+	int timeout;
+#ifdef G_OS_UNIX
+	struct pollfd pfd[2];
+	nfds_t nfds;
+	int ret;
+#endif
+
+	if (src->follow_gone || input_follow_stopped(src)) {
+		g_debug("cli: Stopped following the input file.");
+		return FALSE;
+	}
+	timeout = -1;
+	if (src->follow_timeout_ms) {
+		idle_ms = (g_get_monotonic_time() - src->follow_last_data) / 1000;
+		if ((uint64_t)idle_ms >= src->follow_timeout_ms) {
+			g_debug("cli: No input data for %" PRIu64 " ms, "
+				"stopped following.", src->follow_timeout_ms);
+			return FALSE;
+		}
+		timeout = MIN(src->follow_timeout_ms - idle_ms, G_MAXINT);
+	}
+	if (src->follow_notify_fd < 0 && (timeout < 0 || timeout > FOLLOW_POLL_MS))
+		timeout = FOLLOW_POLL_MS;
+
+#ifdef G_OS_UNIX
+	pfd[0].fd = follow_signal_pipe[0];
+	pfd[0].events = POLLIN;
+	pfd[0].revents = 0;
+	nfds = 1;
+	if (src->follow_notify_fd >= 0) {
+		pfd[1].fd = src->follow_notify_fd;
+		pfd[1].events = POLLIN;
+		pfd[1].revents = 0;
+		nfds = 2;
+	}
+	do {
+		ret = poll(pfd, nfds, timeout);
+	} while (ret < 0 && errno == EINTR && !follow_stopped);
+#ifdef HAVE_SYS_INOTIFY_H
+	if (nfds > 1 && (pfd[1].revents & POLLIN))
+		input_follow_drain(src);
+#endif
+#else
+	g_usleep(timeout * 1000);
+#endif
+
+	/* Data which was appended before a removal still gets read. */
+	return TRUE;
+}
+
+static gboolean input_chunk_fill(struct input_source *src,
+	struct input_chunk *chunk)
+{
+	volatile const char *page;
+	size_t count, offset;
+	ssize_t len;
+
+	chunk->data = NULL;
+	chunk->offset = src->file_pos;
+	chunk->length = 0;
+
+	/* Grow the chunk size with every chunk, up to the limit. */
+	count = src->chunk_size;
+	src->chunk_size = MIN(src->chunk_size * 2, src->chunk_size_max);
+
+	if (src->map) {
+		if (src->file_pos >= src->map_size)
+			return FALSE;
+		count = MIN(src->map_size - src->file_pos, count);
+		/* Fault the pages in here, not in the parser. */
+		page = &src->map[src->file_pos];
+		for (offset = 0; offset < count; offset += src->page_size)
+			(void)page[offset];
+		chunk->view.str = (char *)&src->map[src->file_pos];
+		chunk->view.len = count;
+		chunk->view.allocated_len = count;
+		chunk->data = &chunk->view;
+		chunk->length = count;
+		src->file_pos += count;
+		return TRUE;
+	}
+
+	if (!chunk->buf)
+		chunk->buf = g_string_sized_new(src->chunk_size_max);
+	g_string_truncate(chunk->buf, 0);
+	if (src->dc) {
+		len = decompressor_read(src->dc, chunk->buf->str, count);
+	} else if (input_follow_stopped(src)) {
+		len = 0;
+	} else {
+		len = read(src->fd, chunk->buf->str, count);
+		while (len == 0 && src->follow && input_follow_wait(src))
+			len = read(src->fd, chunk->buf->str, count);
+		if (len < 0)
+			src->read_errno = errno;
+		if (len > 0 && src->follow)
+			src->follow_last_data = g_get_monotonic_time();
+	}
+	if (len <= 0)
+		return FALSE;
+	chunk->buf->len = len;
+	chunk->data = chunk->buf;
+	chunk->length = len;
+	src->file_pos += len;
+
+	return TRUE;
+}
+
+static gpointer input_reader_thread(gpointer data)
+{
+	struct input_source *src;
+	struct input_chunk *chunk;
+	gboolean more;
+	gint64 start;
+
+	src = data;
+	more = TRUE;
+	while (more) {
+		start = g_get_monotonic_time();
+		chunk = g_async_queue_pop(src->free_chunks);
+		src->reader_wait_us += g_get_monotonic_time() - start;
+		if (g_atomic_int_get(&src->stop))
+			break;
+		input_chunk_release(src, chunk);
+		more = input_chunk_fill(src, chunk);
+		g_async_queue_push(src->full_chunks, chunk);
+	}
+
+	return NULL;
+}
+
+/*
+ * Wait until input data is available. Returns FALSE when the timeout
+ * (in milliseconds, or -1) expired.
+ */
+static gboolean input_stream_wait(int fd, int timeout)
+{
+#ifdef G_OS_UNIX
+	struct pollfd pfd;
+	int ret;
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	do {
+		ret = poll(&pfd, 1, timeout);
+	} while (ret < 0 && errno == EINTR);
+
+	return ret != 0;
+#else
+	(void)fd;
+	(void)timeout;
+
+	return TRUE;
+#endif
+}
+
+/*
+ * Identify the format of streamed input early: after the first few KiB
+ * of data, or when the producer pauses. More data gets received when
+ * that's not enough for the input modules.
+ */
+static void input_stream_scan(int fd, GString *buf, const struct sr_input **in)
+{
+	ssize_t len;
+
+	while (buf->len < CHUNK_SIZE_MIN) {
+		if (input_stream_wait(fd, buf->len ? STREAM_SCAN_WAIT_MS : -1)) {
+			len = read(fd, &buf->str[buf->len], CHUNK_SIZE_MIN - buf->len);
+			if (len < 0 && errno == EINTR)
+				continue;
+			if (len < 0)
+				g_critical("Failed to read %s: %s.", opt_input_file,
+						g_strerror(errno));
+			if (len <= 0)
+				break;
+			buf->len += len;
+			buf->str[buf->len] = '\0';
+			if (buf->len < STREAM_SCAN_MIN)
+				continue;
+		}
+		if (sr_input_scan_buffer(buf, in) == SR_OK)
+			return;
+	}
+	if (buf->len)
+		sr_input_scan_buffer(buf, in);
+}
+
+/* Pass on whatever data is available, as soon as there is some. */
+static gboolean input_stream_fill(struct input_source *src,
+	struct input_chunk *chunk)
+{
+	ssize_t len;
+
+	chunk->data = NULL;
+	if (!chunk->buf)
+		chunk->buf = g_string_sized_new(src->chunk_size_max);
+	do {
+		input_stream_wait(src->fd, -1);
+		len = read(src->fd, chunk->buf->str, src->chunk_size_max);
+	} while (len < 0 && errno == EINTR);
+	if (len < 0)
+		src->read_errno = errno;
+	if (len <= 0)
+		return FALSE;
+	chunk->buf->len = len;
+	chunk->data = chunk->buf;
+	src->file_pos += len;
+
+	return TRUE;
+}
+
+static void input_source_init(struct input_source *src, int fd,
+	struct decompressor *dc, gboolean is_stdin, size_t chunk_size_max)
+{
+	struct stat st;
+	size_t idx;
+
+	memset(src, 0, sizeof(*src));
+	src->fd = fd;
+	src->dc = dc;
+	src->chunk_size_max = chunk_size_max;
+	src->chunk_size = MIN(CHUNK_SIZE_MIN, chunk_size_max);
+	if (opt_stream && is_stdin) {
+		src->stream = TRUE;
+		return;
+	}
+	input_follow_init(src, is_stdin);
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+		input_source_advise(src, &st);
+		/* The mapping would not grow with a followed file. */
+		if (!is_stdin && !dc && !src->follow)
+			input_source_map(src, &st);
+	}
+	/* Chunk offsets don't refer to the file's content then. */
+	if (dc)
+		src->drop_behind = FALSE;
+
+	src->free_chunks = g_async_queue_new();
+	src->full_chunks = g_async_queue_new();
+	for (idx = 0; idx < READAHEAD_CHUNKS; idx++)
+		g_async_queue_push(src->free_chunks, &src->chunks[idx]);
+	src->reader = g_thread_new("input-reader", input_reader_thread, src);
+}
+
+/*
+ * Get the next chunk of input data. Returns NULL at the end of the
+ * file or stream. The returned string must not be modified, it may
+ * refer to the file's memory mapping. It remains valid until the
+ * next call.
+ */
+static GString *input_source_read(struct input_source *src)
+{
+	struct input_chunk *chunk;
+	gint64 start;
+
+	if (src->current) {
+		g_async_queue_push(src->free_chunks, src->current);
+		src->current = NULL;
+	}
+	if (src->eof)
+		return NULL;
+
+	if (src->stream) {
+		src->current = NULL;
+		if (!input_stream_fill(src, &src->chunks[0])) {
+			src->eof = TRUE;
+			if (src->read_errno)
+				g_critical("Read failed: %s",
+					g_strerror(src->read_errno));
+			return NULL;
+		}
+		return src->chunks[0].data;
+	}
+
+	start = g_get_monotonic_time();
+	chunk = g_async_queue_pop(src->full_chunks);
+	src->parser_wait_us += g_get_monotonic_time() - start;
+	src->current = chunk;
+	if (!chunk->data) {
+		src->eof = TRUE;
+		if (src->read_errno)
+			g_critical("Read failed: %s", g_strerror(src->read_errno));
+		if (src->dc && decompressor_error(src->dc))
+			g_critical("Failed to decompress %s: %s.", opt_input_file,
+				decompressor_error(src->dc));
+		return NULL;
+	}
+
+	return chunk->data;
+}
+
+static void input_source_close(struct input_source *src)
+{
+	struct input_chunk *chunk;
+	size_t idx;
+
+	if (src->stream) {
+		if (src->chunks[0].buf)
+			g_string_free(src->chunks[0].buf, TRUE);
+		close(src->fd);
+		return;
+	}
+
+	/* Unblock the reader thread in case the parser stopped early. */
+	g_atomic_int_set(&src->stop, 1);
+	if (src->current)
+		g_async_queue_push(src->free_chunks, src->current);
+	src->current = NULL;
+	while ((chunk = g_async_queue_try_pop(src->full_chunks)))
+		g_async_queue_push(src->free_chunks, chunk);
+	g_thread_join(src->reader);
+	g_async_queue_unref(src->free_chunks);
+	g_async_queue_unref(src->full_chunks);
+
+	g_message("cli: Input read-ahead: parser waited %.3f s for I/O, "
+		"I/O waited %.3f s for parser.",
+		src->parser_wait_us / 1e6, src->reader_wait_us / 1e6);
+
+	for (idx = 0; idx < READAHEAD_CHUNKS; idx++) {
+		if (src->chunks[idx].buf)
+			g_string_free(src->chunks[idx].buf, TRUE);
+	}
+#ifdef HAVE_SYS_MMAN_H
+	if (src->map)
+		munmap((void *)src->map, src->map_size);
+#endif
+	src->map = NULL;
+	input_follow_cleanup(src);
+	decompressor_free(src->dc);
+	src->dc = NULL;
+	close(src->fd);
+}
+
+static uint32_t rd_le32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* Get the number of sample frames from a WAV file's header. */
+static gboolean wav_frame_count(const char *path, uint64_t *frames)
+{
+	FILE *f;
+	uint8_t hdr[12], fmt[16];
+	uint32_t size;
+	uint16_t block_align;
+	gboolean ok;
+
+	if (!(f = g_fopen(path, "rb")))
+		return FALSE;
+	ok = fread(hdr, 1, sizeof(hdr), f) == sizeof(hdr)
+		&& memcmp(hdr, "RIFF", 4) == 0 && memcmp(&hdr[8], "WAVE", 4) == 0;
+	block_align = 0;
+	while (ok && fread(hdr, 1, 8, f) == 8) {
+		size = rd_le32(&hdr[4]);
+		if (memcmp(hdr, "fmt ", 4) == 0) {
+			if (size < sizeof(fmt) || fread(fmt, 1, sizeof(fmt), f) != sizeof(fmt))
+				break;
+			block_align = fmt[12] | (fmt[13] << 8);
+			size -= sizeof(fmt);
+		} else if (memcmp(hdr, "data", 4) == 0) {
+			/* Streamed files don't have the data size filled in. */
+			fclose(f);
+			if (!block_align || !size || size == 0xffffffff)
+				return FALSE;
+			*frames = size / block_align;
+			return TRUE;
+		}
+		/* Chunks are padded to an even size. */
+		if (fseek(f, size + (size & 1), SEEK_CUR) != 0)
+			break;
+	}
+	fclose(f);
+
+	return FALSE;
+}
+
+/*
+ * For formats which have the sample count determined by the file's
+ * size and header, get the count without parsing all of the data.
+ * The channels and the samplerate are known after the first chunk.
+ * The counts replace what datafeed_in() counted, when the data ends.
+ */
+static gboolean input_props_from_size(const struct sr_input *in, int fd,
+	struct df_arg_desc *df_arg)
+{
+	struct stat st;
+	const char *id;
+	uint64_t frames;
+
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+		return FALSE;
+	id = sr_input_id_get(sr_input_module_get(in));
+	if (!id)
+		return FALSE;
+
+	if (strcmp(id, "binary") == 0) {
+		df_arg->size_counts.logic_bytes = st.st_size;
+		df_arg->size_counts.from = "file size";
+		return TRUE;
+	}
+	if (strcmp(id, "wav") == 0 && wav_frame_count(opt_input_file, &frames)) {
+		df_arg->size_counts.analog = frames;
+		df_arg->size_counts.from = "file header";
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+static void load_input_file_module(struct df_arg_desc *df_arg,
+	const char *cache_key)
 {
 	struct sr_session *session;
 	const struct sr_input *in;
@@ -38,8 +771,11 @@ static void load_input_file_module(struct df_arg_desc *df_arg)
 	const struct sr_option **options;
 	struct sr_dev_inst *sdi;
 	GHashTable *mod_args, *mod_opts;
-	GString *buf;
-	gboolean got_sdi;
+	struct input_source src;
+	struct decompressor *dc;
+	struct input_cache *cache;
+	GString *buf, *chunk;
+	gboolean got_sdi, eof;
 	int fd;
 	ssize_t len;
 	char *mod_id;
@@ -51,6 +787,7 @@ static void load_input_file_module(struct df_arg_desc *df_arg)
 
 	mod_id = NULL;
 	mod_args = NULL;
+	mod_opts = NULL;
 	if (opt_input_format) {
 		mod_args = parse_generic_arg(opt_input_format, TRUE, NULL);
 		mod_id = g_hash_table_lookup(mod_args, "sigrok_key");
@@ -59,7 +796,14 @@ static void load_input_file_module(struct df_arg_desc *df_arg)
 	is_stdin = strcmp(opt_input_file, "-") == 0;
 	push_scan_data = FALSE;
 	fd = 0;
-	buf = g_string_sized_new(CHUNK_SIZE);
+	dc = NULL;
+	buf = g_string_sized_new(CHUNK_SIZE_MIN);
+	if (!is_stdin) {
+		if ((fd = open(opt_input_file, O_RDONLY)) < 0)
+			g_critical("Failed to load %s: %s.", opt_input_file,
+					g_strerror(errno));
+		dc = decompressor_open(fd, opt_input_file);
+	}
 	if (mod_id) {
 		/* User specified an input module to use. */
 		if (!(imod = sr_input_find(mod_id)))
@@ -69,55 +813,69 @@ static void load_input_file_module(struct df_arg_desc *df_arg)
 			mod_opts = generic_arg_to_opt(options, mod_args);
 			(void)warn_unknown_keys(options, mod_args, NULL);
 			sr_input_options_free(options);
-		} else {
-			mod_opts = NULL;
 		}
 		if (!(in = sr_input_new(imod, mod_opts)))
 			g_critical("Error: failed to initialize input module.");
-		if (mod_opts)
-			g_hash_table_destroy(mod_opts);
 		if (mod_args)
 			g_hash_table_destroy(mod_args);
-		if (!is_stdin && (fd = open(opt_input_file, O_RDONLY)) < 0)
-			g_critical("Failed to load %s: %s.", opt_input_file,
-					g_strerror(errno));
 	} else {
-		if (!is_stdin) {
+		if (!is_stdin && !dc) {
 			/*
 			 * An actual filename: let the input modules try to
 			 * identify the file.
 			 */
-			if (sr_input_scan_file(opt_input_file, &in) == SR_OK) {
-				/* That worked, reopen the file for reading. */
-				fd = open(opt_input_file, O_RDONLY);
-			}
+			sr_input_scan_file(opt_input_file, &in);
+		} else if (dc) {
+			/*
+			 * A compressed file: let the input modules try to
+			 * identify the decompressed content.
+			 */
+			if ((len = decompressor_read(dc, buf->str, buf->allocated_len)) < 1)
+				g_critical("Failed to decompress %s: %s.", opt_input_file,
+						len < 0 ? decompressor_error(dc) : "no data");
+			buf->len = len;
+			sr_input_scan_buffer(buf, &in);
+			push_scan_data = TRUE;
 		} else {
 			/*
 			 * Taking input from a pipe: let the input modules try
 			 * to identify the stream content.
 			 */
-			if (is_stdin) {
-				/* stdin */
-				fd = 0;
+			if (opt_stream) {
+				input_stream_scan(fd, buf, &in);
 			} else {
-				fd = open(opt_input_file, O_RDONLY);
-				if (fd == -1)
-					g_critical("Failed to load %s: %s.", opt_input_file,
+				if ((len = read(fd, buf->str, buf->allocated_len)) < 1)
+					g_critical("Failed to read %s: %s.", opt_input_file,
 							g_strerror(errno));
+				buf->len = len;
+				sr_input_scan_buffer(buf, &in);
 			}
-			if ((len = read(fd, buf->str, buf->allocated_len)) < 1)
-				g_critical("Failed to read %s: %s.", opt_input_file,
-						g_strerror(errno));
-			buf->len = len;
-			sr_input_scan_buffer(buf, &in);
 			push_scan_data = TRUE;
 		}
 		if (!in)
 			g_critical("Error: no input module found for this file.");
 	}
+	cache = cache_key ? input_cache_new(cache_key) : NULL;
+
+	/* Large CSV files get parsed by several threads. */
+	if (!is_stdin && !dc && !opt_follow
+			&& split_load_input(sr_input_module_get(in), mod_opts,
+			fd, cache, df_arg) == SR_OK) {
+		sr_input_free(in);
+		if (mod_opts)
+			g_hash_table_destroy(mod_opts);
+		close(fd);
+		g_string_free(buf, TRUE);
+		return;
+	}
+	if (mod_opts)
+		g_hash_table_destroy(mod_opts);
+
 	sr_session_new(sr_ctx, &session);
 	df_arg->session = session;
 	sr_session_datafeed_callback_add(session, datafeed_in, df_arg);
+	if (cache)
+		sr_session_datafeed_callback_add(session, input_cache_packet, cache);
 
 	/*
 	 * Implementation detail: The combination of reading from stdin
@@ -125,7 +883,7 @@ static void load_input_file_module(struct df_arg_desc *df_arg)
 	 * chunk of input data into the input module's data accumulator,
 	 * _bypassing_ the .receive() callback. It is essential to call
 	 * .receive() before calling .end() for files of size smaller than
-	 * CHUNK_SIZE (which is a typical case). So that sdi becomes ready.
+	 * the first read (which is a typical case). So that sdi becomes ready.
 	 * Fortunately all input modules accept .receive() calls with
 	 * a zero length, and inspect whatever was accumulated so far.
 	 *
@@ -133,21 +891,20 @@ static void load_input_file_module(struct df_arg_desc *df_arg)
 	 * above during format detection, continue reading remaining
 	 * chunks from the input file until EOF is seen.
 	 */
+	input_source_init(&src, fd, dc, is_stdin, input_chunk_size_max(in));
 	got_sdi = FALSE;
-	while (TRUE) {
-		g_string_truncate(buf, 0);
-		if (push_scan_data)
-			len = 0;
-		else
-			len = read(fd, buf->str, buf->allocated_len);
-		if (len < 0)
-			g_critical("Read failed: %s", g_strerror(errno));
-		if (len == 0 && !push_scan_data)
+	eof = FALSE;
+	while (!sample_window_done()) {
+		if (push_scan_data) {
+			g_string_truncate(buf, 0);
+			chunk = buf;
+		} else if (!(chunk = input_source_read(&src))) {
 			/* End of file or stream. */
+			eof = TRUE;
 			break;
+		}
 		push_scan_data = FALSE;
-		buf->len = len;
-		if (sr_input_send(in, buf) != SR_OK) {
+		if (sr_input_send(in, chunk) != SR_OK) {
 			g_critical("File import failed (read)");
 			break;
 		}
@@ -166,16 +923,77 @@ static void load_input_file_module(struct df_arg_desc *df_arg)
 			}
 			got_sdi = TRUE;
 		}
+
+		/* Properties may not need all of the file's content. */
+		if (df_arg->do_props && got_sdi && !is_stdin && !dc && !opt_follow
+				&& input_props_from_size(in, fd, df_arg))
+			break;
 	}
 	sr_input_end(in);
+	input_cache_close(cache, eof);
 	sr_input_free(in);
+	input_source_close(&src);
 	g_string_free(buf, TRUE);
-	close(fd);
 
 	df_arg->session = NULL;
 	sr_session_destroy(session);
 }
 
+/*
+ * libsigrok opens session files by name, and needs random access to
+ * their content. Compressed session files get decompressed into a
+ * temporary file. Returns the temporary file's name, or NULL when the
+ * file is not a compressed session file.
+ */
+static gchar *stage_compressed_session(const char *path)
+{
+	struct decompressor *dc;
+	gchar *tmp_path;
+	FILE *tmp;
+	char *buf;
+	ssize_t len;
+	int fd, tmp_fd;
+	gboolean ok;
+
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return NULL;
+	if (!(dc = decompressor_open(fd, path))) {
+		close(fd);
+		return NULL;
+	}
+
+	buf = g_malloc(CHUNK_SIZE);
+	tmp_path = NULL;
+	len = decompressor_read(dc, buf, 4);
+	if (len == 4 && !memcmp(buf, "PK\x03\x04", 4)) {
+		tmp_fd = g_file_open_tmp("sigrok-cli-XXXXXX.sr", &tmp_path, NULL);
+		tmp = tmp_fd >= 0 ? fdopen(tmp_fd, "wb") : NULL;
+		if (!tmp)
+			g_critical("Failed to create temporary file: %s.",
+				g_strerror(errno));
+		ok = TRUE;
+		while (ok && len > 0) {
+			ok = fwrite(buf, len, 1, tmp) == 1;
+			len = decompressor_read(dc, buf, CHUNK_SIZE);
+		}
+		ok = fclose(tmp) == 0 && ok;
+		if (!ok || len < 0) {
+			g_unlink(tmp_path);
+			if (len < 0)
+				g_critical("Failed to decompress %s: %s.", path,
+					decompressor_error(dc));
+			g_critical("Failed to write %s: %s.", tmp_path,
+				g_strerror(errno));
+		}
+		g_debug("cli: Decompressed session file into %s.", tmp_path);
+	}
+	g_free(buf);
+	decompressor_free(dc);
+	close(fd);
+
+	return tmp_path;
+}
+
 void load_input_file(gboolean do_props)
 {
 	struct df_arg_desc df_arg;
@@ -183,16 +1001,30 @@ void load_input_file(gboolean do_props)
 	struct sr_dev_inst *sdi;
 	GSList *devices;
 	GMainLoop *main_loop;
+#ifdef HAVE_LIBZIP
+	struct srzip *zs;
+#endif
+	gchar *cache_key, *staged, *idx_path;
+	const char *path;
 	int ret;
 
 	memset(&df_arg, 0, sizeof(df_arg));
 	df_arg.do_props = do_props;
+	if (setup_sample_window() != SR_OK)
+		return;
+#ifdef HAVE_SRD
+	/* Decoder output of an earlier run, with the same input and setup. */
+	if (opt_pds && !do_props && pd_cache_replay())
+		return;
+#endif
 
 	if (!strcmp(opt_input_file, "-")) {
 		/* Input from stdin is never a session file. */
-		load_input_file_module(&df_arg);
+		load_input_file_module(&df_arg, NULL);
 	} else {
-		if ((ret = sr_session_load(sr_ctx, opt_input_file,
+		staged = stage_compressed_session(opt_input_file);
+		path = staged ? staged : opt_input_file;
+		if ((ret = sr_session_load(sr_ctx, path,
 				&session)) == SR_OK) {
 			/* sigrok session file */
 			ret = sr_session_dev_list(session, &devices);
@@ -200,17 +1032,37 @@ void load_input_file(gboolean do_props)
 				g_critical("Failed to access session device.");
 				g_slist_free(devices);
 				sr_session_destroy(session);
-				return;
+				goto done;
 			}
 			sdi = devices->data;
 			g_slist_free(devices);
 			if (select_channels(sdi) != SR_OK) {
 				sr_session_destroy(session);
-				return;
+				goto done;
 			}
+#ifdef HAVE_LIBZIP
+			/*
+			 * Read logic data directly, this allows to skip
+			 * chunks before the requested range, and uses
+			 * the file's index. Properties are taken from the
+			 * file's metadata.
+			 */
+			if (srzip_open(path, &zs) == SR_OK) {
+				df_arg.session = session;
+				if (do_props)
+					srzip_props(zs, sdi, &df_arg);
+				else
+					srzip_feed(zs, sdi, &df_arg);
+				srzip_close(zs);
+				df_arg.session = NULL;
+				sr_session_destroy(session);
+				goto done;
+			}
+#endif
 			main_loop = g_main_loop_new(NULL, FALSE);
 
 			df_arg.session = session;
+			df_arg.stoppable = TRUE;
 			sr_session_datafeed_callback_add(session,
 				datafeed_in, &df_arg);
 			sr_session_stopped_callback_set(session,
@@ -226,8 +1078,27 @@ void load_input_file(gboolean do_props)
 			/* It's a session file, but it didn't work out somehow. */
 			g_critical("Failed to load session file.");
 		} else {
-			/* Fall back on input modules. */
-			load_input_file_module(&df_arg);
+			/*
+			 * Fall back on input modules, unless the data was
+			 * converted before and can be replayed from the cache.
+			 */
+			cache_key = NULL;
+			if (opt_cache && !opt_follow)
+				cache_key = cache_file_key(opt_input_file,
+					opt_input_format);
+			if (!cache_key ||
+					input_cache_replay(cache_key, &df_arg) != SR_OK)
+				load_input_file_module(&df_arg, cache_key);
+			g_free(cache_key);
+		}
+done:
+		if (staged) {
+			/* Also remove the index which srzip_feed() may have saved. */
+			idx_path = g_strconcat(staged, ".idx", NULL);
+			g_unlink(idx_path);
+			g_free(idx_path);
+			g_unlink(staged);
+			g_free(staged);
 		}
 	}
 }
@@ -228,6 +228,82 @@ static void set_options(void)
 	sr_dev_close(sdi);
 }
 
+#ifdef HAVE_SRD
+/*
+ * Create the decode session, register the protocol decoder stacks,
+ * and the output callback for the decoder output which gets shown.
+ */
+int pd_session_setup(void)
+{
+	if (srd_session_new(&srd_sess) != SRD_OK) {
+		g_critical("Failed to create new decode session.");
+		return 1;
+	}
+	if (register_pds(opt_pds, opt_pd_annotations) != 0)
+		return 1;
+
+	/*
+	 * Only one output type is ever shown. A database receives all
+	 * of them, -A, -M and -B select what gets stored.
+	 */
+	if (opt_pd_sqlite) {
+		if (opt_pd_annotations
+				&& setup_pd_annotations(opt_pd_annotations) != 0)
+			return 1;
+		if (opt_pd_meta && setup_pd_meta(opt_pd_meta) != 0)
+			return 1;
+		if (opt_pd_binary && setup_pd_binary(opt_pd_binary) != 0)
+			return 1;
+		if (pd_profile_callback_add(srd_sess, SRD_OUTPUT_ANN,
+				show_pd_annotations, NULL) != SRD_OK
+				|| pd_profile_callback_add(srd_sess,
+				SRD_OUTPUT_META, show_pd_meta, NULL) != SRD_OK
+				|| pd_profile_callback_add(srd_sess,
+				SRD_OUTPUT_BINARY, show_pd_binary, NULL) != SRD_OK)
+			return 1;
+	} else if (opt_pd_binary) {
+		if (setup_pd_binary(opt_pd_binary) != 0)
+			return 1;
+		if (setup_binary_stdout() != 0)
+			return 1;
+		if (pd_profile_callback_add(srd_sess, SRD_OUTPUT_BINARY,
+				show_pd_binary, NULL) != SRD_OK)
+			return 1;
+	} else if (opt_pd_meta) {
+		if (setup_pd_meta(opt_pd_meta) != 0)
+			return 1;
+		if (pd_profile_callback_add(srd_sess, SRD_OUTPUT_META,
+				show_pd_meta, NULL) != SRD_OK)
+			return 1;
+	} else {
+		if (opt_pd_annotations)
+			if (setup_pd_annotations(opt_pd_annotations) != 0)
+				return 1;
+		if (opt_pd_records && setup_binary_stdout() != 0)
+			return 1;
+		if (pd_profile_callback_add(srd_sess, SRD_OUTPUT_ANN,
+				show_pd_annotations, NULL) != SRD_OK)
+			return 1;
+	}
+	show_pd_prepare();
+
+	return 0;
+}
+
+/*
+ * Replace the decode session by a fresh one, for another input file.
+ * Decoders which were loaded before remain available.
+ */
+int pd_session_renew(void)
+{
+	if (srd_sess)
+		srd_session_destroy(srd_sess);
+	srd_sess = NULL;
+
+	return pd_session_setup();
+}
+#endif
+
 int main(int argc, char **argv)
 {
 	g_log_set_default_handler(logger, NULL);
@@ -248,45 +324,29 @@ int main(int argc, char **argv)
 		g_critical("Option -B will not take effect in the absence of -P.");
 		goto done;
 	}
+	if (opt_pd_records && (opt_pd_meta || opt_pd_jsontrace)) {
+		g_critical("Option --protocol-decoder-records does not apply to -M or JSON trace output.");
+		goto done;
+	}
+	if (opt_pd_sqlite && (opt_pd_records || opt_pd_jsontrace
+			|| (opt_input_files && opt_input_files[1]))) {
+		g_critical("Option --protocol-decoder-sqlite takes the output of a single capture, and no other output format.");
+		goto done;
+	}
 
 	/* Set the loglevel (amount of messages to output) for libsigrokdecode. */
 	if (srd_log_loglevel_set(opt_loglevel) != SRD_OK)
 		goto done;
 
 	if (opt_pds) {
-		if (srd_init(NULL) != SRD_OK)
+		if (setup_output_flush() != 0)
 			goto done;
-		if (srd_session_new(&srd_sess) != SRD_OK) {
-			g_critical("Failed to create new decode session.");
+		if (srd_init(NULL) != SRD_OK)
 			goto done;
-		}
-		if (register_pds(opt_pds, opt_pd_annotations) != 0)
+		if (pd_session_setup() != 0)
 			goto done;
-
-		/* Only one output type is ever shown. */
-		if (opt_pd_binary) {
-			if (setup_pd_binary(opt_pd_binary) != 0)
-				goto done;
-			if (setup_binary_stdout() != 0)
-				goto done;
-			if (srd_pd_output_callback_add(srd_sess, SRD_OUTPUT_BINARY,
-					show_pd_binary, NULL) != SRD_OK)
-				goto done;
-		} else if (opt_pd_meta) {
-			if (setup_pd_meta(opt_pd_meta) != 0)
-				goto done;
-			if (srd_pd_output_callback_add(srd_sess, SRD_OUTPUT_META,
-					show_pd_meta, NULL) != SRD_OK)
-				goto done;
-		} else {
-			if (opt_pd_annotations)
-				if (setup_pd_annotations(opt_pd_annotations) != 0)
-					goto done;
-			if (srd_pd_output_callback_add(srd_sess, SRD_OUTPUT_ANN,
-					show_pd_annotations, NULL) != SRD_OK)
-				goto done;
-		}
-		show_pd_prepare();
+		pd_split_start();
+		pd_workers_start();
 	}
 #endif
 
@@ -296,6 +356,8 @@ int main(int argc, char **argv)
 		show_supported();
 	else if (opt_list_supported_wiki)
 		show_supported_wiki();
+	else if (opt_input_files && opt_input_files[1] && opt_show)
+		batch_run(TRUE);
 	else if (opt_input_file && opt_show)
 		load_input_file(TRUE);
 	else if (opt_input_format && opt_show)
@@ -312,6 +374,8 @@ int main(int argc, char **argv)
 #endif
 	else if (opt_show)
 		show_dev_detail();
+	else if (opt_input_files && opt_input_files[1])
+		batch_run(FALSE);
 	else if (opt_input_file)
 		load_input_file(FALSE);
 	else if (opt_gets)
@@ -326,8 +390,12 @@ int main(int argc, char **argv)
 		show_help();
 
 #ifdef HAVE_SRD
+	if (opt_pds)
+		pd_workers_stop();
 	if (opt_pds)
 		show_pd_close();
+	if (opt_pds)
+		pd_profile_report();
 	if (opt_pds)
 		srd_exit();
 #endif
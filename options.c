@@ -29,6 +29,11 @@ gboolean opt_scan_devs = FALSE;
 gboolean opt_dont_scan = FALSE;
 gboolean opt_wait_trigger = FALSE;
 gchar *opt_input_file = NULL;
+gboolean opt_stream = FALSE;
+gboolean opt_cache = FALSE;
+gboolean opt_follow = FALSE;
+gchar *opt_follow_timeout = NULL;
+gchar **opt_input_files = NULL;
 gchar *opt_output_file = NULL;
 gchar *opt_drv = NULL;
 gchar **opt_configs = NULL;
@@ -43,6 +48,14 @@ gchar *opt_pd_binary = NULL;
 gboolean opt_pd_ann_class = FALSE;
 gboolean opt_pd_samplenum = FALSE;
 gboolean opt_pd_jsontrace = FALSE;
+gboolean opt_pd_records = FALSE;
+gchar *opt_pd_sqlite = NULL;
+gboolean opt_pd_profile = FALSE;
+gchar *opt_pd_elide = NULL;
+gboolean opt_pd_cache = FALSE;
+gboolean opt_pd_split = FALSE;
+gchar *opt_pd_overlap = NULL;
+gchar *opt_pd_flush = NULL;
 #endif
 gchar *opt_input_format = NULL;
 gchar *opt_output_format = NULL;
@@ -52,6 +65,10 @@ gchar *opt_time = NULL;
 gchar *opt_samples = NULL;
 gchar *opt_frames = NULL;
 gboolean opt_continuous = FALSE;
+gchar *opt_overload = NULL;
+gchar *opt_from = NULL;
+gchar *opt_to = NULL;
+gint opt_jobs = 1;
 gchar **opt_gets = NULL;
 gboolean opt_set = FALSE;
 gboolean opt_list_serial = FALSE;
@@ -90,10 +107,18 @@ CHECK_ONCE(opt_triggers)
 CHECK_ONCE(opt_pd_annotations)
 CHECK_ONCE(opt_pd_meta)
 CHECK_ONCE(opt_pd_binary)
+CHECK_ONCE(opt_pd_overlap)
+CHECK_ONCE(opt_pd_flush)
+CHECK_ONCE(opt_pd_sqlite)
+CHECK_ONCE(opt_pd_elide)
 #endif
 CHECK_ONCE(opt_time)
 CHECK_ONCE(opt_samples)
 CHECK_ONCE(opt_frames)
+CHECK_ONCE(opt_overload)
+CHECK_ONCE(opt_from)
+CHECK_ONCE(opt_to)
+CHECK_ONCE(opt_follow_timeout)
 
 #undef CHECK_STR_ONCE
 
@@ -114,7 +139,15 @@ static const GOptionEntry optargs[] = {
 	{"config", 'c', 0, G_OPTION_ARG_STRING_ARRAY, &opt_configs,
 			"Specify device configuration options", NULL},
 	{"input-file", 'i', 0, G_OPTION_ARG_FILENAME_ARRAY, &input_file_array,
-			"Load input from file", NULL},
+			"Load input from file(s)", NULL},
+	{"stream", 0, 0, G_OPTION_ARG_NONE, &opt_stream,
+			"Pass on input from stdin as soon as it arrives", NULL},
+	{"cache", 0, 0, G_OPTION_ARG_NONE, &opt_cache,
+			"Cache converted input files", NULL},
+	{"follow", 0, 0, G_OPTION_ARG_NONE, &opt_follow,
+			"Keep reading data which gets appended to the input file", NULL},
+	{"follow-timeout", 0, 0, G_OPTION_ARG_CALLBACK, &check_opt_follow_timeout,
+			"Stop following after this long without new data (ms)", NULL},
 	{"input-format", 'I', 0, G_OPTION_ARG_CALLBACK, &check_opt_input_format,
 			"Input format", NULL},
 	{"output-file", 'o', 0, G_OPTION_ARG_FILENAME_ARRAY, &output_file_array,
@@ -146,6 +179,22 @@ static const GOptionEntry optargs[] = {
 			"Show sample numbers in decoder output", NULL},
 	{"protocol-decoder-jsontrace", 0, 0, G_OPTION_ARG_NONE, &opt_pd_jsontrace,
 			"Output in Google Trace Event format (JSON)", NULL},
+	{"protocol-decoder-records", 0, 0, G_OPTION_ARG_NONE, &opt_pd_records,
+			"Output binary records", NULL},
+	{"protocol-decoder-sqlite", 0, 0, G_OPTION_ARG_CALLBACK, &check_opt_pd_sqlite,
+			"Store decoder output in an SQLite database", NULL},
+	{"protocol-decoder-profile", 0, 0, G_OPTION_ARG_NONE, &opt_pd_profile,
+			"Show decoder time and output counts at exit", NULL},
+	{"protocol-decoder-elide", 0, 0, G_OPTION_ARG_CALLBACK, &check_opt_pd_elide,
+			"Shorten idle runs of decoder inputs to this many samples", NULL},
+	{"protocol-decoder-cache", 0, 0, G_OPTION_ARG_NONE, &opt_pd_cache,
+			"Reuse decoder output of earlier runs", NULL},
+	{"protocol-decoder-split", 0, 0, G_OPTION_ARG_NONE, &opt_pd_split,
+			"Decode an input file in parallel segments", NULL},
+	{"protocol-decoder-overlap", 0, 0, G_OPTION_ARG_CALLBACK, &check_opt_pd_overlap,
+			"Overlap of decoded segments (samples)", NULL},
+	{"protocol-decoder-flush", 0, 0, G_OPTION_ARG_CALLBACK, &check_opt_pd_flush,
+			"When to flush decoder output (always, size or time)", NULL},
 #endif
 	{"scan", 0, 0, G_OPTION_ARG_NONE, &opt_scan_devs,
 			"Scan for devices", NULL},
@@ -161,6 +210,14 @@ static const GOptionEntry optargs[] = {
 			"Number of frames to acquire", NULL},
 	{"continuous", 0, 0, G_OPTION_ARG_NONE, &opt_continuous,
 			"Sample continuously", NULL},
+	{"overload", 0, 0, G_OPTION_ARG_CALLBACK, &check_opt_overload,
+			"Policy when output can't keep up (block, drop, decimate)", NULL},
+	{"from", 0, 0, G_OPTION_ARG_CALLBACK, &check_opt_from,
+			"Start of the input file range (samples or time)", NULL},
+	{"to", 0, 0, G_OPTION_ARG_CALLBACK, &check_opt_to,
+			"End of the input file range (samples or time)", NULL},
+	{"jobs", 'j', 0, G_OPTION_ARG_INT, &opt_jobs,
+			"Number of parallel jobs (0 for all processors)", NULL},
 	{"get", 0, 0, G_OPTION_ARG_STRING_ARRAY, &opt_gets,
 			"Get device options only", NULL},
 	{"set", 0, 0, G_OPTION_ARG_NONE, &opt_set, "Set device options only", NULL},
@@ -189,14 +246,13 @@ int parse_options(int argc, char **argv)
 	 * Because of encoding issues with filenames (mentioned in the glib
 	 * documentation), we don't check them with a callback function, but
 	 * collect them into arrays and then check if the arrays contain at
-	 * most one element.
+	 * most one element. Multiple input files (including patterns and
+	 * list files) are processed in batch mode.
 	 */
 	if (NULL != input_file_array) {
-		if (NULL != input_file_array[0] && NULL != input_file_array[1]) {
-			g_critical("option \"--input-file/-i\" only allowed once");
+		if (!(opt_input_files = batch_expand_inputs(input_file_array)))
 			goto done;
-		}
-		opt_input_file = g_strdup(input_file_array[0]);
+		opt_input_file = g_strdup(opt_input_files[0]);
 	}
 
 	if (NULL != output_file_array) {
@@ -207,6 +263,13 @@ int parse_options(int argc, char **argv)
 		opt_output_file = g_strdup(output_file_array[0]);
 	}
 
+	if (opt_jobs < 0) {
+		g_critical("Invalid number of jobs %d.", opt_jobs);
+		goto done;
+	}
+	if (opt_jobs == 0)
+		opt_jobs = g_get_num_processors();
+
 	if (1 != argc) {
 		g_critical("superfluous command line argument \"%s\"", argv[1]);
 		goto done;
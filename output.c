@@ -17,7 +17,9 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <config.h>
 #include <stdio.h>
+#include <string.h>
 
 #ifdef _WIN32
 #include <io.h>
@@ -25,8 +27,31 @@
 #endif
 
 #include <glib.h>
+#ifdef G_OS_UNIX
+#include <unistd.h>
+#endif
 #include "sigrok-cli.h"
 
+/*
+ * Decoder output gets written through stdio's buffer, and flushed
+ * according to a policy: after every write (for interactive use), when
+ * the buffer is full, or when some time has passed since the last flush.
+ */
+enum flush_policy {
+	FLUSH_ALWAYS,
+	FLUSH_SIZE,
+	FLUSH_INTERVAL,
+};
+
+#define OUTPUT_BUF_SIZE		(64 * 1024)
+/* Live captures still show their output in a timely fashion. */
+#define OUTPUT_INTERVAL_MS	250
+
+static enum flush_policy flush_policy = FLUSH_ALWAYS;
+static gint64 flush_interval;
+static gint64 flush_last;
+static char *output_buf;
+
 /* Disable newline translation on stdout when outputting binary data. */
 int setup_binary_stdout(void)
 {
@@ -39,3 +64,98 @@ int setup_binary_stdout(void)
 #endif
 	return 0;
 }
+
+#ifdef HAVE_SRD
+/*
+ * Set up the flush policy for decoder output. Needs to run before
+ * anything gets written to stdout.
+ */
+int setup_output_flush(void)
+{
+	uint64_t size, interval_ms;
+	size_t len;
+
+	size = OUTPUT_BUF_SIZE;
+	interval_ms = OUTPUT_INTERVAL_MS;
+	if (opt_pd_flush) {
+		len = strlen(opt_pd_flush);
+		if (!strcmp(opt_pd_flush, "always")) {
+			flush_policy = FLUSH_ALWAYS;
+		} else if (len && opt_pd_flush[len - 1] == 's') {
+			flush_policy = FLUSH_INTERVAL;
+			interval_ms = sr_parse_timestring(opt_pd_flush);
+			if (!interval_ms) {
+				g_critical("Invalid flush interval '%s'.", opt_pd_flush);
+				return -1;
+			}
+		} else {
+			flush_policy = FLUSH_SIZE;
+			if (sr_parse_sizestring(opt_pd_flush, &size) != SR_OK
+					|| !size || size > G_MAXINT) {
+				g_critical("Invalid flush size '%s'.", opt_pd_flush);
+				return -1;
+			}
+		}
+#ifdef G_OS_UNIX
+	} else if (isatty(STDOUT_FILENO)) {
+		flush_policy = FLUSH_ALWAYS;
+#endif
+	} else if (opt_input_file) {
+		flush_policy = FLUSH_SIZE;
+	} else {
+		flush_policy = FLUSH_INTERVAL;
+	}
+
+	if (flush_policy == FLUSH_ALWAYS)
+		return 0;
+	flush_interval = interval_ms * 1000;
+	flush_last = g_get_monotonic_time();
+	output_buf = g_malloc(size);
+	if (setvbuf(stdout, output_buf, _IOFBF, size) != 0) {
+		g_free(output_buf);
+		output_buf = NULL;
+		flush_policy = FLUSH_ALWAYS;
+	}
+	g_debug("cli: Decoder output flush policy %s.",
+		flush_policy == FLUSH_SIZE ? "size" : "interval");
+
+	return 0;
+}
+#endif
+
+/* Flush the decoder output, when the policy asks for it. */
+void output_flush_check(void)
+{
+	gint64 now;
+
+	switch (flush_policy) {
+	case FLUSH_ALWAYS:
+		fflush(stdout);
+		break;
+	case FLUSH_INTERVAL:
+		now = g_get_monotonic_time();
+		if (now - flush_last >= flush_interval) {
+			fflush(stdout);
+			flush_last = now;
+		}
+		break;
+	case FLUSH_SIZE:
+		/* Full buffers get written by stdio. */
+		break;
+	}
+}
+
+void output_write(const void *data, size_t len)
+{
+	fwrite(data, 1, len, stdout);
+#ifdef HAVE_SRD
+	pd_cache_put(data, len);
+#endif
+	output_flush_check();
+}
+
+void output_flush(void)
+{
+	fflush(stdout);
+	flush_last = g_get_monotonic_time();
+}
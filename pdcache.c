@@ -0,0 +1,259 @@
+/*
+ * This file is part of the sigrok-cli project.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#include "sigrok-cli.h"
+
+#ifdef HAVE_SRD
+/*
+ * Decoder results (--protocol-decoder-cache). The output of a decode
+ * run gets stored in the cache directory (see cache.c), and is written
+ * again when the same input file is decoded with the same setup. The
+ * key covers the input file's identity and a hash of its first and last
+ * MiB, the libsigrokdecode version, the decoder stacks with their
+ * options and channel assignments, and all options which affect the
+ * output. The output is stored compressed, when zlib is available.
+ * Incomplete results are never visible under their final name.
+ */
+
+/* Bytes at the start and at the end of the input, which get hashed. */
+#define PD_CACHE_HASH_SIZE	(1024 * 1024)
+
+static struct {
+	gboolean capturing;
+	gchar *path;
+	gchar *tmp_path;
+	gboolean failed;
+#ifdef HAVE_ZLIB
+	gzFile file;
+#else
+	FILE *file;
+#endif
+} pdc;
+
+/* Only decoder output which goes to stdout, of a single complete file. */
+static gboolean pd_cache_applies(void)
+{
+	if (!opt_pd_cache || !opt_input_file)
+		return FALSE;
+	if (!strcmp(opt_input_file, "-") || opt_follow
+			|| (opt_input_files && opt_input_files[1]))
+		return FALSE;
+	if (opt_output_file || opt_output_format || opt_transform_module)
+		return FALSE;
+	if (opt_pd_sqlite || opt_pd_profile || opt_pd_split)
+		return FALSE;
+
+	return TRUE;
+}
+
+/* Hash the start and the end of the input file. */
+static gboolean pd_cache_hash_content(GString *params)
+{
+	GChecksum *sum;
+	FILE *f;
+	guchar *buf;
+	size_t len;
+	gboolean ok;
+
+	if (!(f = g_fopen(opt_input_file, "rb")))
+		return FALSE;
+	buf = g_malloc(PD_CACHE_HASH_SIZE);
+	sum = g_checksum_new(G_CHECKSUM_SHA256);
+	len = fread(buf, 1, PD_CACHE_HASH_SIZE, f);
+	g_checksum_update(sum, buf, len);
+	ok = !ferror(f);
+	if (ok && len == PD_CACHE_HASH_SIZE
+			&& fseek(f, -PD_CACHE_HASH_SIZE, SEEK_END) == 0) {
+		len = fread(buf, 1, PD_CACHE_HASH_SIZE, f);
+		g_checksum_update(sum, buf, len);
+		ok = !ferror(f);
+	}
+	g_string_append_printf(params, "content %s\n",
+		g_checksum_get_string(sum));
+	g_checksum_free(sum);
+	g_free(buf);
+	fclose(f);
+
+	return ok;
+}
+
+static gchar *pd_cache_key(void)
+{
+	GString *params;
+	gchar *key;
+	int idx;
+
+	params = g_string_new(NULL);
+	if (!pd_cache_hash_content(params)) {
+		g_string_free(params, TRUE);
+		return NULL;
+	}
+	g_string_append_printf(params, "srd %s\n",
+		srd_lib_version_string_get());
+	for (idx = 0; opt_pds[idx]; idx++)
+		g_string_append_printf(params, "P %s\n", opt_pds[idx]);
+	if (opt_configs)
+		for (idx = 0; opt_configs[idx]; idx++)
+			g_string_append_printf(params, "c %s\n",
+				opt_configs[idx]);
+	g_string_append_printf(params,
+		"I %s\nC %s\nA %s\nM %s\nB %s\nfrom %s\nto %s\nelide %s\n"
+		"flags %d %d %d %d\nloglevel %d\n",
+		opt_input_format ? opt_input_format : "",
+		opt_channels ? opt_channels : "",
+		opt_pd_annotations ? opt_pd_annotations : "",
+		opt_pd_meta ? opt_pd_meta : "",
+		opt_pd_binary ? opt_pd_binary : "",
+		opt_from ? opt_from : "", opt_to ? opt_to : "",
+		opt_pd_elide ? opt_pd_elide : "",
+		opt_pd_ann_class, opt_pd_samplenum, opt_pd_jsontrace,
+		opt_pd_records, opt_loglevel);
+	key = cache_file_key(opt_input_file, params->str);
+	g_string_free(params, TRUE);
+
+	return key;
+}
+
+/* Write the stored output of an earlier run. */
+static gboolean pd_cache_replay_file(const char *path)
+{
+	char buf[64 * 1024];
+	gboolean ok;
+#ifdef HAVE_ZLIB
+	gzFile file;
+	int len;
+
+	if (!(file = gzopen(path, "rb")))
+		return FALSE;
+	while ((len = gzread(file, buf, sizeof(buf))) > 0)
+		output_write(buf, len);
+	ok = len == 0;
+	gzclose(file);
+#else
+	FILE *file;
+	size_t len;
+
+	if (!(file = g_fopen(path, "rb")))
+		return FALSE;
+	while ((len = fread(buf, 1, sizeof(buf), file)) > 0)
+		output_write(buf, len);
+	ok = !ferror(file);
+	fclose(file);
+#endif
+
+	return ok;
+}
+
+/*
+ * Show the cached decoder output for the input file, when there is one.
+ * Otherwise prepare to store this run's output. Returns TRUE when the
+ * input need not be decoded.
+ */
+gboolean pd_cache_replay(void)
+{
+	gchar *key;
+
+	if (!pd_cache_applies() || pdc.path)
+		return FALSE;
+	if (!(key = pd_cache_key()))
+		return FALSE;
+	pdc.path = cache_path("decode", key);
+	g_free(key);
+	if (!pdc.path)
+		return FALSE;
+
+	if (g_file_test(pdc.path, G_FILE_TEST_IS_REGULAR)) {
+		if (pd_cache_replay_file(pdc.path)) {
+			g_debug("cli: Replayed decoder output from %s.",
+				pdc.path);
+			return TRUE;
+		}
+		/* Output may have been written, decoding would repeat it. */
+		g_critical("Cannot read cached decoder output %s.", pdc.path);
+	}
+
+	pdc.tmp_path = g_strdup_printf("%s.%d.tmp", pdc.path, (int)getpid());
+#ifdef HAVE_ZLIB
+	pdc.file = gzopen(pdc.tmp_path, "wb1");
+#else
+	pdc.file = g_fopen(pdc.tmp_path, "wb");
+#endif
+	if (!pdc.file) {
+		g_debug("cli: Cannot create cache file %s.", pdc.tmp_path);
+		return FALSE;
+	}
+	pdc.capturing = TRUE;
+	pdc.failed = FALSE;
+
+	return FALSE;
+}
+
+/* Keep a copy of decoder output, see output_write(). */
+void pd_cache_put(const void *data, size_t len)
+{
+	if (!pdc.capturing || pdc.failed || !len)
+		return;
+#ifdef HAVE_ZLIB
+	if (gzwrite(pdc.file, data, len) != (int)len)
+		pdc.failed = TRUE;
+#else
+	if (fwrite(data, len, 1, pdc.file) != 1)
+		pdc.failed = TRUE;
+#endif
+}
+
+/* Decoding failed, its output must not be replayed. */
+void pd_cache_discard(void)
+{
+	pdc.failed = TRUE;
+}
+
+/* Store the output of a completed decode run. */
+void pd_cache_finish(void)
+{
+	if (pdc.capturing) {
+#ifdef HAVE_ZLIB
+		if (gzclose(pdc.file) != Z_OK)
+			pdc.failed = TRUE;
+#else
+		if (fclose(pdc.file) != 0)
+			pdc.failed = TRUE;
+#endif
+		if (!pdc.failed && g_rename(pdc.tmp_path, pdc.path) == 0) {
+			g_debug("cli: Stored decoder output in %s.", pdc.path);
+		} else {
+			g_debug("cli: Cannot store decoder output.");
+			g_unlink(pdc.tmp_path);
+		}
+		pdc.capturing = FALSE;
+	}
+	g_free(pdc.tmp_path);
+	g_free(pdc.path);
+	pdc.tmp_path = pdc.path = NULL;
+}
+#endif
@@ -0,0 +1,269 @@
+/*
+ * This file is part of the sigrok-cli project.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <time.h>
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+#include <glib.h>
+#include "sigrok-cli.h"
+
+#ifdef HAVE_SRD
+/*
+ * Decoder profiling (--protocol-decoder-profile). The time which is
+ * spent in the decode session gets measured around the calls which send
+ * it data, the decoders of all stacks run within those. The output
+ * callbacks get wrapped, to count the output of every decoder instance.
+ *
+ * CPU time is taken from thread clocks, other threads of the program
+ * (input read-ahead, CSV parsers, srzip inflaters) keep running while
+ * decoding. libsigrokdecode runs every stack in a thread of its own,
+ * those threads get known from their first output callback, and their
+ * clocks are read when the session returns. Without thread clocks,
+ * only the wall clock time gets shown.
+ */
+
+#if defined HAVE_PTHREAD_H && defined HAVE_PTHREAD_GETCPUCLOCKID \
+		&& defined CLOCK_THREAD_CPUTIME_ID
+#define HAVE_PD_PROFILE_CPU 1
+#endif
+
+/* Output types, as far as they get counted. */
+#define PD_PROFILE_TYPES	8
+
+#ifdef HAVE_PD_PROFILE_CPU
+struct pd_profile_thread {
+	clockid_t clock;
+	/* CPU time up to which it was counted. */
+	gint64 counted;
+};
+#endif
+
+struct pd_profile_inst {
+	gchar *inst_id;
+	gchar *decoder;
+	uint64_t counts[PD_PROFILE_TYPES];
+};
+
+static struct {
+	srd_pd_output_callback callbacks[PD_PROFILE_TYPES];
+	/* Instances by ID, and in the order of their first output. */
+	GHashTable *insts;
+	GSList *order;
+	uint64_t samples;
+	gint64 wall_usec;
+	gint64 wall_start;
+#ifdef HAVE_PD_PROFILE_CPU
+	/* Decoder threads, and the thread which sends the session data. */
+	GSList *threads;
+	GMutex threads_mutex;
+	GThread *sender;
+	gint64 cpu_usec;
+	gint64 cpu_start;
+#endif
+} prof;
+
+#ifdef HAVE_PD_PROFILE_CPU
+static GPrivate prof_thread_key;
+
+static gboolean pd_profile_cpu_time(clockid_t clock, gint64 *usec)
+{
+	struct timespec ts;
+
+	if (clock_gettime(clock, &ts) != 0)
+		return FALSE;
+	*usec = (gint64)ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+
+	return TRUE;
+}
+
+/* Get to know the decoder thread an output callback runs in. */
+static void pd_profile_thread_seen(void)
+{
+	struct pd_profile_thread *thread;
+	clockid_t clock;
+
+	if (g_private_get(&prof_thread_key) || g_thread_self() == prof.sender)
+		return;
+	if (pthread_getcpuclockid(pthread_self(), &clock) != 0)
+		return;
+
+	/* All of its CPU time is spent decoding. */
+	thread = g_malloc0(sizeof(*thread));
+	thread->clock = clock;
+	g_private_set(&prof_thread_key, thread);
+	g_mutex_lock(&prof.threads_mutex);
+	prof.threads = g_slist_prepend(prof.threads, thread);
+	g_mutex_unlock(&prof.threads_mutex);
+}
+
+/* Count the decoder threads' CPU time, up to now. */
+static void pd_profile_threads_count(void)
+{
+	struct pd_profile_thread *thread;
+	GSList *l;
+	gint64 now;
+
+	g_mutex_lock(&prof.threads_mutex);
+	for (l = prof.threads; l; l = l->next) {
+		thread = l->data;
+		if (!pd_profile_cpu_time(thread->clock, &now)
+				|| now < thread->counted)
+			continue;
+		prof.cpu_usec += now - thread->counted;
+		thread->counted = now;
+	}
+	g_mutex_unlock(&prof.threads_mutex);
+}
+#endif
+
+static struct pd_profile_inst *pd_profile_inst(const struct srd_decoder_inst *di)
+{
+	struct pd_profile_inst *inst;
+
+	if (!prof.insts)
+		prof.insts = g_hash_table_new(g_str_hash, g_str_equal);
+	if ((inst = g_hash_table_lookup(prof.insts, di->inst_id)))
+		return inst;
+
+	inst = g_malloc0(sizeof(*inst));
+	inst->inst_id = g_strdup(di->inst_id);
+	inst->decoder = g_strdup(di->decoder->id);
+	g_hash_table_insert(prof.insts, inst->inst_id, inst);
+	prof.order = g_slist_append(prof.order, inst);
+
+	return inst;
+}
+
+static void pd_profile_output(struct srd_proto_data *pdata, void *cb_data)
+{
+	struct pd_profile_inst *inst;
+	int type;
+
+	type = pdata->pdo->output_type;
+	if (type < 0 || type >= PD_PROFILE_TYPES)
+		return;
+#ifdef HAVE_PD_PROFILE_CPU
+	pd_profile_thread_seen();
+#endif
+	inst = pd_profile_inst(pdata->pdo->di);
+	inst->counts[type]++;
+	if (prof.callbacks[type])
+		prof.callbacks[type](pdata, cb_data);
+}
+
+/* Register an output callback, which counts the output first. */
+int pd_profile_callback_add(struct srd_session *sess, int output_type,
+	srd_pd_output_callback cb, void *cb_data)
+{
+	if (!opt_pd_profile || output_type < 0
+			|| output_type >= PD_PROFILE_TYPES)
+		return srd_pd_output_callback_add(sess, output_type,
+			cb, cb_data);
+
+	prof.callbacks[output_type] = cb;
+#ifdef HAVE_PD_PROFILE_CPU
+	prof.sender = g_thread_self();
+#endif
+
+	return srd_pd_output_callback_add(sess, output_type,
+		pd_profile_output, cb_data);
+}
+
+void pd_profile_begin(void)
+{
+	if (!opt_pd_profile)
+		return;
+	prof.wall_start = g_get_monotonic_time();
+#ifdef HAVE_PD_PROFILE_CPU
+	prof.sender = g_thread_self();
+	if (!pd_profile_cpu_time(CLOCK_THREAD_CPUTIME_ID, &prof.cpu_start))
+		prof.cpu_start = -1;
+#endif
+}
+
+void pd_profile_end(uint64_t samples)
+{
+#ifdef HAVE_PD_PROFILE_CPU
+	gint64 now;
+#endif
+
+	if (!opt_pd_profile)
+		return;
+	prof.wall_usec += g_get_monotonic_time() - prof.wall_start;
+#ifdef HAVE_PD_PROFILE_CPU
+	if (prof.cpu_start >= 0
+			&& pd_profile_cpu_time(CLOCK_THREAD_CPUTIME_ID, &now))
+		prof.cpu_usec += now - prof.cpu_start;
+	pd_profile_threads_count();
+#endif
+	prof.samples += samples;
+}
+
+/*
+ * The decoder threads of the session are gone after it was reset, the
+ * threads it starts next get their own entries.
+ */
+void pd_profile_session_reset(void)
+{
+#ifdef HAVE_PD_PROFILE_CPU
+	if (!opt_pd_profile)
+		return;
+	g_mutex_lock(&prof.threads_mutex);
+	g_slist_free_full(prof.threads, g_free);
+	prof.threads = NULL;
+	g_mutex_unlock(&prof.threads_mutex);
+#endif
+}
+
+/* Show the time and the output counts per decoder instance. */
+void pd_profile_report(void)
+{
+	struct pd_profile_inst *inst;
+	GSList *l;
+	double wall;
+
+	if (!opt_pd_profile)
+		return;
+
+	wall = prof.wall_usec / 1e6;
+#ifdef HAVE_PD_PROFILE_CPU
+	fprintf(stderr, "Decoded %" PRIu64 " samples in %.3f s "
+		"(%.3f s CPU), %.0f samples/s.\n", prof.samples, wall,
+		prof.cpu_usec / 1e6, wall > 0 ? prof.samples / wall : 0);
+#else
+	fprintf(stderr, "Decoded %" PRIu64 " samples in %.3f s, "
+		"%.0f samples/s.\n", prof.samples, wall,
+		wall > 0 ? prof.samples / wall : 0);
+#endif
+	fprintf(stderr, "%-20s %-16s %12s %10s %10s %12s\n", "Instance",
+		"Decoder", "Annotations", "Meta", "Binary", "Ann./s");
+	for (l = prof.order; l; l = l->next) {
+		inst = l->data;
+		fprintf(stderr, "%-20s %-16s %12" PRIu64 " %10" PRIu64
+			" %10" PRIu64 " %12.0f\n", inst->inst_id, inst->decoder,
+			inst->counts[SRD_OUTPUT_ANN], inst->counts[SRD_OUTPUT_META],
+			inst->counts[SRD_OUTPUT_BINARY],
+			wall > 0 ? inst->counts[SRD_OUTPUT_ANN] / wall : 0);
+	}
+	fflush(stderr);
+}
+#endif
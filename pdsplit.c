@@ -0,0 +1,361 @@
+/*
+ * This file is part of the sigrok-cli project.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#ifdef G_OS_UNIX
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#include "sigrok-cli.h"
+
+#ifdef HAVE_SRD
+/*
+ * Parallel decoding of one input file (--protocol-decoder-split). The
+ * logic data gets spooled to a temporary file first. The capture is then
+ * cut into segments at idle regions, where none of the decoders' input
+ * channels change. Each segment gets decoded by a process of its own,
+ * with a fresh copy of the (not yet started) decode session.
+ *
+ * Segments start some samples before their split point, so that the
+ * decoders can synchronize, and continue some samples after their end.
+ * A segment only shows the output which starts within its own range,
+ * which removes the duplicates from the overlapping parts. The output
+ * of the first segment goes to stdout directly, the other segments'
+ * output is kept in temporary files and gets copied in segment order.
+ */
+
+#if defined G_OS_UNIX && defined HAVE_SYS_MMAN_H
+#define HAVE_PD_SPLIT 1
+#endif
+
+extern struct srd_session *srd_sess;
+
+/* Smaller captures are not worth the processes. */
+#define PD_SPLIT_MIN_SAMPLES	(4 * 1024 * 1024)
+/* Decoders get the segment's data in pieces of this size. */
+#define PD_SPLIT_PIECE_SIZE	(4 * 1024 * 1024)
+
+struct pd_segment {
+	/* Samples which the decoders receive. */
+	uint64_t from;
+	uint64_t to;
+	/* Samples whose output this segment shows. */
+	uint64_t own_from;
+	uint64_t own_to;
+	pid_t pid;
+	int out_fd;
+};
+
+static struct {
+	gboolean active;
+	FILE *spool;
+	uint64_t samples;
+	int unitsize;
+} split;
+
+gboolean pd_split_active(void)
+{
+	return split.active;
+}
+
+/*
+ * Enable split decoding when it was requested and can be done. Runs after
+ * the decode session was set up.
+ */
+void pd_split_start(void)
+{
+	if (!opt_pd_split)
+		return;
+#ifdef HAVE_PD_SPLIT
+	if (!opt_input_file || (opt_input_files && opt_input_files[1])
+			|| opt_follow || opt_pd_jsontrace || opt_pd_sqlite
+			|| opt_pd_profile || opt_pd_elide) {
+		g_warning("Split decoding only applies to a single input "
+			"file, and not to JSON trace or database output, "
+			"profiling or idle run elision.");
+		return;
+	}
+	split.active = TRUE;
+#else
+	g_warning("Split decoding is not supported on this platform.");
+#endif
+}
+
+#ifdef HAVE_PD_SPLIT
+static uint64_t pd_split_overlap(uint64_t min_idle)
+{
+	char *end;
+	uint64_t overlap;
+
+	if (!opt_pd_overlap)
+		return 10 * min_idle;
+
+	overlap = g_ascii_strtoull(opt_pd_overlap, &end, 10);
+	if (end == opt_pd_overlap || *end)
+		g_critical("Invalid decoder overlap '%s'.", opt_pd_overlap);
+
+	return overlap;
+}
+
+/* Get a sample's first (up to) 64 channels, in channel index order. */
+static uint64_t pd_split_sample(const uint8_t *p, int unitsize)
+{
+	uint64_t value;
+	int idx;
+
+	value = 0;
+	for (idx = 0; idx < unitsize && idx < 8; idx++)
+		value |= (uint64_t)p[idx] << (8 * idx);
+
+	return value;
+}
+
+/*
+ * Find a split point at or after 'from', in the middle of a run of more
+ * than 'min_idle' samples where the masked channels don't change.
+ * Returns 0 when there is none before 'to'.
+ */
+static uint64_t pd_split_find_idle(const uint8_t *map, uint64_t mask,
+	uint64_t from, uint64_t to, uint64_t min_idle)
+{
+	uint64_t pos, run;
+
+	for (pos = from; pos < to; pos += run) {
+		run = pd_same_samples(&map[pos * split.unitsize], to - pos,
+			split.unitsize, mask, pd_split_sample(
+			&map[pos * split.unitsize], split.unitsize));
+		if (run > min_idle)
+			return pos + run / 2;
+	}
+
+	return 0;
+}
+
+/* Run the decode session on a range of the spooled samples. */
+static int pd_split_decode(const uint8_t *map, uint64_t from, uint64_t to)
+{
+	uint64_t pos, count, piece;
+	int ret;
+
+	if ((ret = srd_session_start(srd_sess)) != SRD_OK)
+		return ret;
+
+	/* Decoders always count from zero, the offset is added for output. */
+	pd_sample_offset += from;
+	piece = MAX(PD_SPLIT_PIECE_SIZE / split.unitsize, 1);
+	for (pos = from; pos < to; pos += count) {
+		count = MIN(to - pos, piece);
+		ret = pd_session_feed(pos - from, pos - from + count,
+			&map[pos * split.unitsize], count * split.unitsize,
+			split.unitsize);
+		if (ret != SRD_OK)
+			return ret;
+	}
+#if defined HAVE_SRD_SESSION_SEND_EOF && HAVE_SRD_SESSION_SEND_EOF
+	(void)srd_session_send_eof(srd_sess);
+#endif
+
+	return SRD_OK;
+}
+
+static void pd_split_spawn(struct pd_segment *seg, const uint8_t *map)
+{
+	int ret;
+
+	fflush(stdout);
+	fflush(stderr);
+	seg->pid = fork();
+	if (seg->pid < 0)
+		g_critical("Cannot create decoder process: %s.", g_strerror(errno));
+	if (seg->pid == 0) {
+		if (seg->out_fd >= 0 && dup2(seg->out_fd, STDOUT_FILENO) < 0)
+			exit(1);
+		pd_output_from = pd_sample_offset + seg->own_from;
+		pd_output_to = seg->own_to == split.samples ? UINT64_MAX
+			: pd_sample_offset + seg->own_to;
+		ret = pd_split_decode(map, seg->from, seg->to);
+		fflush(stdout);
+		exit(ret == SRD_OK ? 0 : 1);
+	}
+}
+
+/* Append a segment's output to stdout. */
+static gboolean pd_split_copy_output(int fd)
+{
+	char buf[64 * 1024];
+	ssize_t len;
+
+	if (lseek(fd, 0, SEEK_SET) != 0)
+		return FALSE;
+	while ((len = read(fd, buf, sizeof(buf))) != 0) {
+		if (len < 0 && errno == EINTR)
+			continue;
+		if (len < 0)
+			return FALSE;
+		output_write(buf, len);
+	}
+
+	return TRUE;
+}
+#endif
+
+/* Keep the logic data, it gets decoded at the end of the input. */
+int pd_split_spool(uint64_t start_sample, uint64_t end_sample,
+	const uint8_t *data, uint64_t len, int unitsize)
+{
+#ifdef HAVE_PD_SPLIT
+	gchar *path;
+	int fd;
+
+	if (!split.spool) {
+		fd = g_file_open_tmp("sigrok-cli-XXXXXX.spool", &path, NULL);
+		if (fd < 0 || !(split.spool = fdopen(fd, "w+b")))
+			g_critical("Failed to create temporary file: %s.",
+				g_strerror(errno));
+		/* Only the descriptor is needed, for decoding. */
+		g_unlink(path);
+		g_free(path);
+		split.unitsize = unitsize;
+	}
+	if (unitsize != split.unitsize || start_sample != split.samples) {
+		g_critical("Split decoding needs a constant unit size.");
+		return SRD_ERR;
+	}
+	if (fwrite(data, len, 1, split.spool) != 1) {
+		g_critical("Failed to spool logic data: %s.", g_strerror(errno));
+		return SRD_ERR;
+	}
+	split.samples = end_sample;
+
+	return SRD_OK;
+#else
+	(void)start_sample;
+	(void)end_sample;
+	(void)data;
+	(void)len;
+	(void)unitsize;
+
+	return SRD_ERR;
+#endif
+}
+
+/* Decode the spooled data, in segments which run in parallel. */
+void pd_split_run(void)
+{
+#ifdef HAVE_PD_SPLIT
+	struct pd_segment *segs;
+	uint8_t *map;
+	uint64_t size, all, mask, min_idle, overlap, target, limit, pos;
+	guint count, nsegs, idx;
+	gchar *path;
+	int status;
+
+	if (!split.spool || !split.samples)
+		return;
+	split.active = FALSE;
+	if (fflush(split.spool) != 0)
+		g_critical("Failed to spool logic data: %s.", g_strerror(errno));
+	size = split.samples * split.unitsize;
+	map = mmap(NULL, size, PROT_READ, MAP_SHARED, fileno(split.spool), 0);
+	if (map == MAP_FAILED)
+		g_critical("Failed to map spooled logic data: %s.",
+			g_strerror(errno));
+
+	count = opt_jobs == 0 ? g_get_num_processors() : (guint)opt_jobs;
+	if (split.samples < PD_SPLIT_MIN_SAMPLES)
+		count = 1;
+	/* Without known decoder inputs, all channels need to be idle. */
+	all = split.unitsize < 8
+		? ((uint64_t)1 << (8 * split.unitsize)) - 1 : UINT64_MAX;
+	mask = pd_input_mask & all;
+	if (!mask)
+		mask = all;
+	min_idle = MAX(pd_samplerate / 1000, 16);
+	if (!pd_samplerate)
+		min_idle = 1000;
+	overlap = pd_split_overlap(min_idle);
+
+	/* Segment borders are the split points after the even shares. */
+	segs = g_malloc0(count * sizeof(*segs));
+	nsegs = 1;
+	for (idx = 1; idx < count; idx++) {
+		target = split.samples / count * idx;
+		limit = split.samples / count * (idx + 1);
+		target = MAX(target, segs[nsegs - 1].own_from + 1);
+		if (target >= limit)
+			continue;
+		pos = pd_split_find_idle(map, mask, target, limit, min_idle);
+		if (!pos)
+			continue;
+		segs[nsegs - 1].own_to = pos;
+		segs[nsegs++].own_from = pos;
+	}
+	segs[nsegs - 1].own_to = split.samples;
+	g_debug("cli: Decoding %" PRIu64 " samples in %u segments.",
+		split.samples, nsegs);
+
+	for (idx = 0; idx < nsegs; idx++) {
+		segs[idx].from = segs[idx].own_from > overlap
+			? segs[idx].own_from - overlap : 0;
+		segs[idx].to = MIN(segs[idx].own_to + overlap, split.samples);
+		segs[idx].out_fd = -1;
+		if (idx > 0) {
+			segs[idx].out_fd = g_file_open_tmp("sigrok-cli-XXXXXX.out",
+				&path, NULL);
+			if (segs[idx].out_fd < 0)
+				g_critical("Failed to create temporary file: %s.",
+					g_strerror(errno));
+			g_unlink(path);
+			g_free(path);
+		}
+		pd_split_spawn(&segs[idx], map);
+	}
+
+	for (idx = 0; idx < nsegs; idx++) {
+		while (waitpid(segs[idx].pid, &status, 0) < 0 && errno == EINTR)
+			;
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			g_critical("Decoding samples %" PRIu64 "-%" PRIu64 " failed.",
+				segs[idx].own_from, segs[idx].own_to);
+		if (segs[idx].out_fd >= 0) {
+			if (!pd_split_copy_output(segs[idx].out_fd))
+				g_critical("Failed to read decoder output: %s.",
+					g_strerror(errno));
+			close(segs[idx].out_fd);
+		}
+	}
+
+	g_free(segs);
+	munmap(map, size);
+	fclose(split.spool);
+	split.spool = NULL;
+	split.samples = 0;
+#endif
+}
+#endif
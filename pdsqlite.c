@@ -0,0 +1,355 @@
+/*
+ * This file is part of the sigrok-cli project.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#ifdef HAVE_SQLITE3
+#include <sqlite3.h>
+#endif
+#include "sigrok-cli.h"
+
+#ifdef HAVE_SRD
+/*
+ * Decoder output to an SQLite database (--protocol-decoder-sqlite). The
+ * output callbacks collect rows in chunks, a writer thread inserts the
+ * chunks' rows with prepared statements, in large transactions. There
+ * is a fixed set of chunks, which go back and forth between the two
+ * threads. The indexes get created after all rows were inserted.
+ */
+
+#ifdef HAVE_SQLITE3
+/* Rows per chunk, chunks in use, rows per transaction. */
+#define PD_SQLITE_CHUNK_ROWS	1024
+#define PD_SQLITE_CHUNKS	16
+#define PD_SQLITE_TX_ROWS	(64 * 1024)
+
+enum {
+	PD_SQLITE_ANN,
+	PD_SQLITE_META,
+	PD_SQLITE_BINARY,
+	PD_SQLITE_STMTS,
+};
+
+struct pd_sqlite_row {
+	int type;
+	uint64_t start;
+	uint64_t end;
+	const struct srd_decoder_inst *di;
+	const char *name;
+	int cls;
+	/* The text or data is kept in the chunk's buffer. */
+	guint offset;
+	guint length;
+};
+
+struct pd_sqlite_chunk {
+	guint count;
+	gboolean last;
+	GByteArray *buf;
+	struct pd_sqlite_row rows[PD_SQLITE_CHUNK_ROWS];
+};
+
+static const char *pd_sqlite_schema =
+	"PRAGMA synchronous = OFF;"
+	"PRAGMA journal_mode = MEMORY;"
+	"CREATE TABLE info (key TEXT PRIMARY KEY, value);"
+	"CREATE TABLE annotations (start_sample INTEGER, end_sample INTEGER,"
+	" instance TEXT, decoder TEXT, class TEXT, text TEXT);"
+	"CREATE TABLE meta (start_sample INTEGER, end_sample INTEGER,"
+	" instance TEXT, decoder TEXT, name TEXT, value TEXT);"
+	"CREATE TABLE binaries (start_sample INTEGER, end_sample INTEGER,"
+	" instance TEXT, decoder TEXT, class TEXT, data BLOB);";
+
+static const char *pd_sqlite_indexes =
+	"CREATE INDEX annotations_start ON annotations (start_sample);"
+	"CREATE INDEX annotations_class ON annotations (class, start_sample);"
+	"CREATE INDEX meta_start ON meta (start_sample);"
+	"CREATE INDEX binaries_start ON binaries (start_sample);"
+	"CREATE INDEX binaries_class ON binaries (class, start_sample);";
+
+static const char *pd_sqlite_inserts[PD_SQLITE_STMTS] = {
+	"INSERT INTO annotations VALUES (?, ?, ?, ?, ?, ?);",
+	"INSERT INTO meta VALUES (?, ?, ?, ?, ?, ?);",
+	"INSERT INTO binaries VALUES (?, ?, ?, ?, ?, ?);",
+};
+
+static struct {
+	sqlite3 *db;
+	sqlite3_stmt *stmts[PD_SQLITE_STMTS];
+	GThread *thread;
+	/* Chunks to be written, and written ones to be filled again. */
+	GAsyncQueue *full;
+	GAsyncQueue *empty;
+	struct pd_sqlite_chunk *chunk;
+	guint tx_rows;
+	/* The first error of the writer thread. */
+	char *error;
+} sq;
+
+static void pd_sqlite_fail(const char *what)
+{
+	if (!sq.error)
+		sq.error = g_strdup_printf("%s: %s", what, sqlite3_errmsg(sq.db));
+}
+
+static const char *pd_sqlite_class(GSList *classes, int cls)
+{
+	char **descr;
+
+	if (cls < 0 || !(descr = g_slist_nth_data(classes, cls)))
+		return NULL;
+
+	return descr[0];
+}
+
+static void pd_sqlite_insert(struct pd_sqlite_chunk *chunk,
+	struct pd_sqlite_row *row)
+{
+	struct srd_decoder *dec;
+	sqlite3_stmt *stmt;
+	const char *cls;
+	const void *data;
+
+	dec = row->di->decoder;
+	stmt = sq.stmts[row->type];
+	data = &chunk->buf->data[row->offset];
+	sqlite3_bind_int64(stmt, 1, row->start);
+	sqlite3_bind_int64(stmt, 2, row->end);
+	sqlite3_bind_text(stmt, 3, row->di->inst_id, -1, SQLITE_STATIC);
+	sqlite3_bind_text(stmt, 4, dec->id, -1, SQLITE_STATIC);
+	switch (row->type) {
+	case PD_SQLITE_ANN:
+		cls = pd_sqlite_class(dec->annotations, row->cls);
+		sqlite3_bind_text(stmt, 5, cls, -1, SQLITE_STATIC);
+		sqlite3_bind_text(stmt, 6, data, row->length, SQLITE_STATIC);
+		break;
+	case PD_SQLITE_META:
+		sqlite3_bind_text(stmt, 5, row->name, -1, SQLITE_STATIC);
+		sqlite3_bind_text(stmt, 6, data, row->length, SQLITE_STATIC);
+		break;
+	case PD_SQLITE_BINARY:
+		cls = pd_sqlite_class(dec->binary, row->cls);
+		sqlite3_bind_text(stmt, 5, cls, -1, SQLITE_STATIC);
+		sqlite3_bind_blob(stmt, 6, data, row->length, SQLITE_STATIC);
+		break;
+	}
+	if (sqlite3_step(stmt) != SQLITE_DONE)
+		pd_sqlite_fail("Cannot insert decoder output");
+	sqlite3_reset(stmt);
+}
+
+static gpointer pd_sqlite_writer(gpointer data)
+{
+	struct pd_sqlite_chunk *chunk;
+	gboolean last;
+	guint idx;
+
+	(void)data;
+
+	do {
+		chunk = g_async_queue_pop(sq.full);
+		for (idx = 0; idx < chunk->count && !sq.error; idx++) {
+			pd_sqlite_insert(chunk, &chunk->rows[idx]);
+			if (++sq.tx_rows < PD_SQLITE_TX_ROWS)
+				continue;
+			sq.tx_rows = 0;
+			if (sqlite3_exec(sq.db, "COMMIT; BEGIN;",
+					NULL, NULL, NULL) != SQLITE_OK)
+				pd_sqlite_fail("Cannot commit decoder output");
+		}
+		last = chunk->last;
+		chunk->count = 0;
+		g_byte_array_set_size(chunk->buf, 0);
+		g_async_queue_push(sq.empty, chunk);
+	} while (!last);
+
+	return NULL;
+}
+
+/* Get a row of the current chunk, with room for the text or data. */
+static struct pd_sqlite_row *pd_sqlite_row(int type,
+	struct srd_proto_data *pdata, const void *data, size_t len)
+{
+	struct pd_sqlite_row *row;
+
+	if (!sq.chunk)
+		sq.chunk = g_async_queue_pop(sq.empty);
+	row = &sq.chunk->rows[sq.chunk->count++];
+	row->type = type;
+	row->start = pd_abs_sample(pdata->start_sample);
+	row->end = pd_abs_sample(pdata->end_sample);
+	row->di = pdata->pdo->di;
+	row->name = NULL;
+	row->cls = -1;
+	row->offset = sq.chunk->buf->len;
+	row->length = MIN(len, G_MAXINT);
+	g_byte_array_append(sq.chunk->buf, data, row->length);
+
+	return row;
+}
+
+/* Hand a full chunk over to the writer. */
+static void pd_sqlite_row_done(void)
+{
+	if (sq.chunk->count < PD_SQLITE_CHUNK_ROWS)
+		return;
+	g_async_queue_push(sq.full, sq.chunk);
+	sq.chunk = NULL;
+}
+#endif
+
+/* Create the database, and start the writer thread. */
+void pd_sqlite_open(const char *path)
+{
+#ifdef HAVE_SQLITE3
+	struct pd_sqlite_chunk *chunk;
+	int idx;
+
+	if (sq.db)
+		return;
+
+	/* The output of a previous run gets replaced. */
+	g_unlink(path);
+	if (sqlite3_open(path, &sq.db) != SQLITE_OK)
+		g_critical("Cannot open database '%s': %s.", path,
+			sqlite3_errmsg(sq.db));
+	if (sqlite3_exec(sq.db, pd_sqlite_schema, NULL, NULL, NULL) != SQLITE_OK
+			|| sqlite3_exec(sq.db, "BEGIN;", NULL, NULL, NULL) != SQLITE_OK)
+		g_critical("Cannot create database '%s': %s.", path,
+			sqlite3_errmsg(sq.db));
+	for (idx = 0; idx < PD_SQLITE_STMTS; idx++) {
+		if (sqlite3_prepare_v2(sq.db, pd_sqlite_inserts[idx], -1,
+				&sq.stmts[idx], NULL) != SQLITE_OK)
+			g_critical("Cannot prepare database statement: %s.",
+				sqlite3_errmsg(sq.db));
+	}
+
+	sq.full = g_async_queue_new();
+	sq.empty = g_async_queue_new();
+	for (idx = 0; idx < PD_SQLITE_CHUNKS; idx++) {
+		chunk = g_malloc0(sizeof(*chunk));
+		chunk->buf = g_byte_array_sized_new(64 * 1024);
+		g_async_queue_push(sq.empty, chunk);
+	}
+	sq.thread = g_thread_new("pd-sqlite", pd_sqlite_writer, NULL);
+#else
+	(void)path;
+
+	g_critical("SQLite support was not built in.");
+#endif
+}
+
+void pd_sqlite_annotation(struct srd_proto_data *pdata)
+{
+#ifdef HAVE_SQLITE3
+	struct srd_proto_data_annotation *pda;
+	struct pd_sqlite_row *row;
+
+	pda = pdata->data;
+	row = pd_sqlite_row(PD_SQLITE_ANN, pdata,
+		pda->ann_text[0], strlen(pda->ann_text[0]));
+	row->cls = pda->ann_class;
+	pd_sqlite_row_done();
+#else
+	(void)pdata;
+#endif
+}
+
+void pd_sqlite_meta(struct srd_proto_data *pdata)
+{
+#ifdef HAVE_SQLITE3
+	struct pd_sqlite_row *row;
+	gchar *value;
+
+	value = g_variant_print(pdata->data, FALSE);
+	row = pd_sqlite_row(PD_SQLITE_META, pdata, value, strlen(value));
+	row->name = pdata->pdo->meta_name;
+	pd_sqlite_row_done();
+	g_free(value);
+#else
+	(void)pdata;
+#endif
+}
+
+void pd_sqlite_binary(struct srd_proto_data *pdata)
+{
+#ifdef HAVE_SQLITE3
+	struct srd_proto_data_binary *pdb;
+	struct pd_sqlite_row *row;
+
+	pdb = pdata->data;
+	row = pd_sqlite_row(PD_SQLITE_BINARY, pdata, pdb->data, pdb->size);
+	row->cls = pdb->bin_class;
+	pd_sqlite_row_done();
+#else
+	(void)pdata;
+#endif
+}
+
+/* Write the remaining rows, and the indexes. */
+void pd_sqlite_close(void)
+{
+#ifdef HAVE_SQLITE3
+	struct pd_sqlite_chunk *chunk;
+	sqlite3_stmt *stmt;
+	int idx;
+
+	if (!sq.db)
+		return;
+
+	if (!sq.chunk)
+		sq.chunk = g_async_queue_pop(sq.empty);
+	sq.chunk->last = TRUE;
+	g_async_queue_push(sq.full, sq.chunk);
+	sq.chunk = NULL;
+	g_thread_join(sq.thread);
+	sq.thread = NULL;
+
+	if (!sq.error && sqlite3_prepare_v2(sq.db,
+			"INSERT INTO info VALUES ('samplerate', ?);",
+			-1, &stmt, NULL) == SQLITE_OK) {
+		sqlite3_bind_int64(stmt, 1, pd_samplerate);
+		if (sqlite3_step(stmt) != SQLITE_DONE)
+			pd_sqlite_fail("Cannot store the samplerate");
+		sqlite3_finalize(stmt);
+	}
+	if (!sq.error && (sqlite3_exec(sq.db, "COMMIT;",
+			NULL, NULL, NULL) != SQLITE_OK
+			|| sqlite3_exec(sq.db, pd_sqlite_indexes,
+			NULL, NULL, NULL) != SQLITE_OK))
+		pd_sqlite_fail("Cannot write database");
+
+	for (idx = 0; idx < PD_SQLITE_STMTS; idx++)
+		sqlite3_finalize(sq.stmts[idx]);
+	sqlite3_close(sq.db);
+	sq.db = NULL;
+	while ((chunk = g_async_queue_try_pop(sq.empty))) {
+		g_byte_array_free(chunk->buf, TRUE);
+		g_free(chunk);
+	}
+	g_async_queue_unref(sq.empty);
+	g_async_queue_unref(sq.full);
+
+	if (sq.error)
+		g_critical("%s.", sq.error);
+#endif
+}
+#endif
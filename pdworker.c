@@ -0,0 +1,731 @@
+/*
+ * This file is part of the sigrok-cli project.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <glib.h>
+#ifdef G_OS_UNIX
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#include "sigrok-cli.h"
+
+#ifdef HAVE_SRD
+/*
+ * Independent protocol decoder stacks (several -P options) run in
+ * worker processes of their own, one per stack. Decoders are Python
+ * code, threads would all wait for the same interpreter lock.
+ *
+ * The workers get forked after the decoders were loaded. Logic data is
+ * copied once into a ring buffer which all workers share, only small
+ * commands which refer to the ring's content go through the pipes.
+ * Every command gets acknowledged by every worker. Ring space is reused
+ * when all workers are done with it.
+ *
+ * The workers send their decoder output back instead of writing it.
+ * Output for one command gets merged across the stacks by the start
+ * sample, each stack's own output remains in the order it was emitted.
+ */
+
+#if defined G_OS_UNIX && defined HAVE_SYS_MMAN_H && defined MAP_ANONYMOUS
+#define HAVE_PD_WORKERS 1
+#endif
+
+extern struct srd_session *srd_sess;
+
+#define PD_RING_SIZE		(32 * 1024 * 1024)
+/* Logic packets get passed on in pieces of at most this size. */
+#define PD_PIECE_SIZE		(PD_RING_SIZE / 4)
+/* Keeps the command pipes well below their capacity. */
+#define PD_MAX_INFLIGHT		64
+
+enum pd_command_type {
+	PD_CMD_CHANNELS,
+	PD_CMD_SAMPLERATE,
+	PD_CMD_START,
+	PD_CMD_LOGIC,
+	PD_CMD_RESET,
+	PD_CMD_EOF,
+};
+
+struct pd_command {
+	uint32_t type;
+	uint32_t unitsize;
+	uint64_t seq;
+	uint64_t start;
+	uint64_t end;
+	/* Ring buffer offset of logic data. */
+	uint64_t offset;
+	/* Size of logic data, or of the payload after the command. */
+	uint64_t length;
+	/* Samplerate, or sample offset for logic data. */
+	uint64_t value;
+};
+
+enum pd_result_type {
+	PD_RES_OUTPUT,
+	PD_RES_ACK,
+	PD_RES_NAK,
+};
+
+struct pd_result {
+	uint32_t type;
+	/* Size of the output data after the result. */
+	uint32_t length;
+	/* Start sample of output, or the acknowledged command's seq. */
+	uint64_t sample;
+};
+
+struct pd_record {
+	gboolean is_ack;
+	uint64_t sample;
+	size_t length;
+	uint8_t data[];
+};
+
+struct pd_worker {
+	pid_t pid;
+	int cmd_fd;
+	int res_fd;
+	GByteArray *inbuf;
+	GQueue records;
+	uint64_t acked;
+};
+
+static struct {
+	struct pd_worker *workers;
+	guint count;
+	uint8_t *ring;
+	/* Ring positions grow monotonically, and wrap at PD_RING_SIZE. */
+	uint64_t head;
+	uint64_t tail;
+	uint64_t ring_end[PD_MAX_INFLIGHT];
+	/* Commands sent, and commands whose output was written. */
+	uint64_t sent;
+	uint64_t flushed;
+	gboolean failed;
+	/* Set in worker processes only. */
+	int res_fd;
+} pdw = { .res_fd = -1, };
+
+#ifdef HAVE_PD_WORKERS
+static gboolean write_all(int fd, const void *data, size_t len)
+{
+	const uint8_t *p;
+	ssize_t ret;
+
+	p = data;
+	while (len) {
+		ret = write(fd, p, len);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return FALSE;
+		p += ret;
+		len -= ret;
+	}
+
+	return TRUE;
+}
+
+static gboolean read_all(int fd, void *data, size_t len)
+{
+	uint8_t *p;
+	ssize_t ret;
+
+	p = data;
+	while (len) {
+		ret = read(fd, p, len);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return FALSE;
+		p += ret;
+		len -= ret;
+	}
+
+	return TRUE;
+}
+
+/* Serialize the channels which matter for the decoders' channel setup. */
+static GByteArray *pd_channels_pack(GSList *channels)
+{
+	struct sr_channel *ch;
+	GByteArray *buf;
+	int32_t fields[3];
+	uint32_t name_len;
+	GSList *l;
+
+	buf = g_byte_array_new();
+	for (l = channels; l; l = l->next) {
+		ch = l->data;
+		fields[0] = ch->index;
+		fields[1] = ch->type;
+		fields[2] = ch->enabled;
+		name_len = strlen(ch->name);
+		g_byte_array_append(buf, (const guint8 *)fields, sizeof(fields));
+		g_byte_array_append(buf, (const guint8 *)&name_len,
+			sizeof(name_len));
+		g_byte_array_append(buf, (const guint8 *)ch->name, name_len);
+	}
+
+	return buf;
+}
+
+static GSList *pd_channels_unpack(const uint8_t *data, size_t len)
+{
+	struct sr_channel *ch;
+	int32_t fields[3];
+	uint32_t name_len;
+	GSList *channels;
+	size_t pos;
+
+	channels = NULL;
+	pos = 0;
+	while (pos + sizeof(fields) + sizeof(name_len) <= len) {
+		memcpy(fields, &data[pos], sizeof(fields));
+		pos += sizeof(fields);
+		memcpy(&name_len, &data[pos], sizeof(name_len));
+		pos += sizeof(name_len);
+		if (name_len > len - pos)
+			break;
+		ch = g_malloc0(sizeof(*ch));
+		ch->index = fields[0];
+		ch->type = fields[1];
+		ch->enabled = fields[2];
+		ch->name = g_strndup((const char *)&data[pos], name_len);
+		pos += name_len;
+		channels = g_slist_append(channels, ch);
+	}
+
+	return channels;
+}
+
+static void pd_channel_free(void *data)
+{
+	struct sr_channel *ch;
+
+	ch = data;
+	g_free(ch->name);
+	g_free(ch);
+}
+
+static void pd_worker_reply(uint32_t type, uint64_t seq)
+{
+	struct pd_result res;
+
+	res.type = type;
+	res.length = 0;
+	res.sample = seq;
+	if (!write_all(pdw.res_fd, &res, sizeof(res)))
+		exit(1);
+}
+
+/* The worker process' main loop, runs one stack's decode session. */
+static void pd_worker_run(guint stack, int cmd_fd)
+{
+	struct pd_command cmd;
+	gchar *stack_pds[2];
+	GSList *channels;
+	uint8_t *payload;
+	int ret;
+
+	/* Start over with a decode session for just this one stack. */
+	srd_session_destroy(srd_sess);
+	srd_sess = NULL;
+	stack_pds[0] = opt_pds[stack];
+	stack_pds[1] = NULL;
+	opt_pds = stack_pds;
+	if (pd_session_setup() != 0)
+		exit(1);
+
+	while (read_all(cmd_fd, &cmd, sizeof(cmd))) {
+		ret = SRD_OK;
+		switch (cmd.type) {
+		case PD_CMD_CHANNELS:
+			payload = g_malloc(cmd.length);
+			if (!read_all(cmd_fd, payload, cmd.length))
+				exit(1);
+			channels = pd_channels_unpack(payload, cmd.length);
+			map_pd_channel_list(channels);
+			g_slist_free_full(channels, pd_channel_free);
+			g_free(payload);
+			break;
+		case PD_CMD_SAMPLERATE:
+			ret = srd_session_metadata_set(srd_sess, SRD_CONF_SAMPLERATE,
+				g_variant_new_uint64(cmd.value));
+			pd_samplerate = cmd.value;
+			break;
+		case PD_CMD_START:
+			ret = srd_session_start(srd_sess);
+			break;
+		case PD_CMD_LOGIC:
+			pd_sample_offset = cmd.value;
+			ret = pd_session_feed(cmd.start, cmd.end,
+				&pdw.ring[cmd.offset], cmd.length, cmd.unitsize);
+			break;
+		case PD_CMD_RESET:
+			ret = srd_session_terminate_reset(srd_sess);
+			break;
+		case PD_CMD_EOF:
+			pd_sample_offset = cmd.value;
+#if defined HAVE_SRD_SESSION_SEND_EOF && HAVE_SRD_SESSION_SEND_EOF
+			(void)srd_session_send_eof(srd_sess);
+#endif
+			break;
+		default:
+			break;
+		}
+		pd_worker_reply(ret == SRD_OK ? PD_RES_ACK : PD_RES_NAK, cmd.seq);
+	}
+}
+
+static gboolean pd_worker_spawn(guint stack)
+{
+	struct pd_worker *w;
+	int cmd_fds[2], res_fds[2];
+	pid_t pid;
+	guint idx;
+
+	if (pipe(cmd_fds) < 0)
+		return FALSE;
+	if (pipe(res_fds) < 0) {
+		close(cmd_fds[0]);
+		close(cmd_fds[1]);
+		return FALSE;
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+	pid = fork();
+	if (pid < 0) {
+		close(cmd_fds[0]);
+		close(cmd_fds[1]);
+		close(res_fds[0]);
+		close(res_fds[1]);
+		return FALSE;
+	}
+	if (pid == 0) {
+		/* Only keep the worker's own ends of the pipes. */
+		for (idx = 0; idx < stack; idx++) {
+			close(pdw.workers[idx].cmd_fd);
+			close(pdw.workers[idx].res_fd);
+		}
+		g_free(pdw.workers);
+		pdw.workers = NULL;
+		pdw.count = 0;
+		close(cmd_fds[1]);
+		close(res_fds[0]);
+		pdw.res_fd = res_fds[1];
+		pd_worker_run(stack, cmd_fds[0]);
+		exit(0);
+	}
+
+	close(cmd_fds[0]);
+	close(res_fds[1]);
+	w = &pdw.workers[stack];
+	w->pid = pid;
+	w->cmd_fd = cmd_fds[1];
+	w->res_fd = res_fds[0];
+	w->inbuf = g_byte_array_new();
+	g_queue_init(&w->records);
+
+	return TRUE;
+}
+
+/* Split the bytes which a worker sent into records. */
+static void pd_worker_parse(struct pd_worker *w)
+{
+	struct pd_result res;
+	struct pd_record *rec;
+	size_t pos;
+
+	pos = 0;
+	while (w->inbuf->len - pos >= sizeof(res)) {
+		memcpy(&res, &w->inbuf->data[pos], sizeof(res));
+		if (w->inbuf->len - pos - sizeof(res) < res.length)
+			break;
+		pos += sizeof(res);
+		rec = g_malloc(sizeof(*rec) + res.length);
+		rec->is_ack = res.type != PD_RES_OUTPUT;
+		rec->sample = res.sample;
+		rec->length = res.length;
+		memcpy(rec->data, &w->inbuf->data[pos], res.length);
+		pos += res.length;
+		g_queue_push_tail(&w->records, rec);
+		if (rec->is_ack)
+			w->acked++;
+		if (res.type == PD_RES_NAK)
+			pdw.failed = TRUE;
+	}
+	g_byte_array_remove_range(w->inbuf, 0, pos);
+}
+
+/*
+ * Write the output for the commands which all workers have completed.
+ * Per command, the workers' output gets merged by the start sample.
+ */
+static void pd_workers_flush(void)
+{
+	struct pd_record *rec, *best;
+	struct pd_worker *bw;
+	uint64_t done;
+	guint idx;
+
+	done = pdw.sent;
+	for (idx = 0; idx < pdw.count; idx++)
+		done = MIN(done, pdw.workers[idx].acked);
+
+	while (pdw.flushed < done) {
+		for (;;) {
+			best = NULL;
+			bw = NULL;
+			for (idx = 0; idx < pdw.count; idx++) {
+				rec = g_queue_peek_head(&pdw.workers[idx].records);
+				if (rec->is_ack)
+					continue;
+				if (!best || rec->sample < best->sample) {
+					best = rec;
+					bw = &pdw.workers[idx];
+				}
+			}
+			if (!best)
+				break;
+			g_queue_pop_head(&bw->records);
+			output_write(best->data, best->length);
+			g_free(best);
+		}
+		for (idx = 0; idx < pdw.count; idx++)
+			g_free(g_queue_pop_head(&pdw.workers[idx].records));
+		pdw.tail = pdw.ring_end[pdw.flushed % PD_MAX_INFLIGHT];
+		pdw.flushed++;
+	}
+}
+
+/* Collect what the workers sent, optionally wait for something. */
+static void pd_workers_poll(gboolean block)
+{
+	struct pollfd *fds;
+	struct pd_worker *w;
+	uint8_t buf[64 * 1024];
+	ssize_t len;
+	guint idx;
+
+	fds = g_malloc(pdw.count * sizeof(*fds));
+	for (idx = 0; idx < pdw.count; idx++) {
+		fds[idx].fd = pdw.workers[idx].res_fd;
+		fds[idx].events = POLLIN;
+		fds[idx].revents = 0;
+	}
+	if (poll(fds, pdw.count, block ? -1 : 0) > 0) {
+		for (idx = 0; idx < pdw.count; idx++) {
+			if (!fds[idx].revents)
+				continue;
+			w = &pdw.workers[idx];
+			len = read(w->res_fd, buf, sizeof(buf));
+			if (len < 0 && errno == EINTR)
+				continue;
+			if (len <= 0)
+				g_critical("Protocol decoder worker for '%s' terminated.",
+					opt_pds[idx]);
+			g_byte_array_append(w->inbuf, buf, len);
+			pd_worker_parse(w);
+		}
+	}
+	g_free(fds);
+
+	pd_workers_flush();
+}
+
+/* Wait until the workers have completed all commands. */
+static int pd_workers_sync(void)
+{
+	while (pdw.flushed < pdw.sent)
+		pd_workers_poll(TRUE);
+
+	return pdw.failed ? SRD_ERR : SRD_OK;
+}
+
+static int pd_workers_command(struct pd_command *cmd, const void *payload)
+{
+	guint idx;
+
+	while (pdw.sent - pdw.flushed >= PD_MAX_INFLIGHT)
+		pd_workers_poll(TRUE);
+	cmd->seq = pdw.sent++;
+	pdw.ring_end[cmd->seq % PD_MAX_INFLIGHT] = pdw.head;
+	for (idx = 0; idx < pdw.count; idx++) {
+		if (!write_all(pdw.workers[idx].cmd_fd, cmd, sizeof(*cmd))
+				|| (payload && !write_all(pdw.workers[idx].cmd_fd,
+				payload, cmd->length)))
+			g_critical("Protocol decoder worker for '%s' terminated.",
+				opt_pds[idx]);
+	}
+	pd_workers_poll(FALSE);
+
+	return pdw.failed ? SRD_ERR : SRD_OK;
+}
+#endif
+
+/*
+ * Fork worker processes for the decoder stacks, when there are several
+ * and the decode session's output can be merged. Runs after the decode
+ * session was set up (which checks the stacks' specs).
+ */
+void pd_workers_start(void)
+{
+#ifdef HAVE_PD_WORKERS
+	guint count, idx;
+	void *ring;
+
+	count = opt_pds ? g_strv_length(opt_pds) : 0;
+	if (count < 2 || opt_pd_jsontrace || opt_pd_records || opt_pd_sqlite
+			|| opt_pd_profile || opt_pd_elide || opt_show || pd_split_active())
+		return;
+	/* Batch workers renew their decode sessions, per input file. */
+	if (opt_input_files && opt_input_files[1])
+		return;
+	if (g_get_num_processors() < 2)
+		return;
+
+	ring = mmap(NULL, PD_RING_SIZE, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (ring == MAP_FAILED)
+		return;
+	pdw.ring = ring;
+	pdw.workers = g_malloc0(count * sizeof(*pdw.workers));
+	for (idx = 0; idx < count; idx++) {
+		if (!pd_worker_spawn(idx))
+			g_critical("Cannot create protocol decoder worker: %s.",
+				g_strerror(errno));
+		pdw.count++;
+	}
+	g_debug("cli: Running %u protocol decoder stacks in worker processes.",
+		count);
+#endif
+}
+
+void pd_workers_stop(void)
+{
+#ifdef HAVE_PD_WORKERS
+	struct pd_worker *w;
+	int status;
+	guint idx;
+
+	if (!pdw.count)
+		return;
+
+	pd_workers_sync();
+	/* Workers terminate when their command pipe gets closed. */
+	for (idx = 0; idx < pdw.count; idx++) {
+		w = &pdw.workers[idx];
+		close(w->cmd_fd);
+		waitpid(w->pid, &status, 0);
+		close(w->res_fd);
+		g_byte_array_free(w->inbuf, TRUE);
+		g_queue_clear_full(&w->records, g_free);
+	}
+	g_free(pdw.workers);
+	pdw.workers = NULL;
+	pdw.count = 0;
+	munmap(pdw.ring, PD_RING_SIZE);
+	pdw.ring = NULL;
+#endif
+}
+
+gboolean pd_workers_active(void)
+{
+	return pdw.count > 0;
+}
+
+/*
+ * Pass decoder output to the process which merges it. Returns FALSE
+ * when not running in a worker process.
+ */
+gboolean pd_worker_output(uint64_t start_sample, const void *data, size_t len)
+{
+#ifdef HAVE_PD_WORKERS
+	struct pd_result res;
+
+	if (pdw.res_fd < 0)
+		return FALSE;
+
+	res.type = PD_RES_OUTPUT;
+	res.length = len;
+	res.sample = start_sample;
+	if (!write_all(pdw.res_fd, &res, sizeof(res))
+			|| !write_all(pdw.res_fd, data, len))
+		exit(1);
+
+	return TRUE;
+#else
+	(void)start_sample;
+	(void)data;
+	(void)len;
+
+	return FALSE;
+#endif
+}
+
+/* Returns FALSE when the decoders' channels are not set up by workers. */
+gboolean pd_workers_channels(GSList *channels)
+{
+#ifdef HAVE_PD_WORKERS
+	struct pd_command cmd;
+	GByteArray *buf;
+
+	if (!pdw.count)
+		return FALSE;
+
+	buf = pd_channels_pack(channels);
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.type = PD_CMD_CHANNELS;
+	cmd.length = buf->len;
+	pd_workers_command(&cmd, buf->data);
+	g_byte_array_free(buf, TRUE);
+
+	return TRUE;
+#else
+	(void)channels;
+
+	return FALSE;
+#endif
+}
+
+int pd_workers_samplerate(uint64_t samplerate)
+{
+#ifdef HAVE_PD_WORKERS
+	struct pd_command cmd;
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.type = PD_CMD_SAMPLERATE;
+	cmd.value = samplerate;
+	pd_workers_command(&cmd, NULL);
+
+	return pd_workers_sync();
+#else
+	(void)samplerate;
+
+	return SRD_ERR;
+#endif
+}
+
+int pd_workers_session_start(void)
+{
+#ifdef HAVE_PD_WORKERS
+	struct pd_command cmd;
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.type = PD_CMD_START;
+	pd_workers_command(&cmd, NULL);
+
+	return pd_workers_sync();
+#else
+	return SRD_ERR;
+#endif
+}
+
+/* Have the workers' decoders start over, after a gap in the data. */
+int pd_workers_reset(void)
+{
+#ifdef HAVE_PD_WORKERS
+	struct pd_command cmd;
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.type = PD_CMD_RESET;
+	pd_workers_command(&cmd, NULL);
+
+	return pd_workers_sync();
+#else
+	return SRD_ERR;
+#endif
+}
+
+int pd_workers_send(uint64_t start_sample, uint64_t end_sample,
+	const uint8_t *data, uint64_t len, int unitsize)
+{
+#ifdef HAVE_PD_WORKERS
+	struct pd_command cmd;
+	uint64_t piece, samples, offset, pad;
+	int ret;
+
+	ret = pdw.failed ? SRD_ERR : SRD_OK;
+	while (len && ret == SRD_OK) {
+		piece = PD_PIECE_SIZE - PD_PIECE_SIZE % unitsize;
+		piece = MIN(len, piece);
+		samples = piece / unitsize;
+		offset = pdw.head % PD_RING_SIZE;
+		pad = offset + piece > PD_RING_SIZE ? PD_RING_SIZE - offset : 0;
+		while (pdw.head + pad + piece - pdw.tail > PD_RING_SIZE)
+			pd_workers_poll(TRUE);
+		if (pad)
+			offset = 0;
+		memcpy(&pdw.ring[offset], data, piece);
+		pdw.head += pad + piece;
+
+		memset(&cmd, 0, sizeof(cmd));
+		cmd.type = PD_CMD_LOGIC;
+		cmd.unitsize = unitsize;
+		cmd.start = start_sample;
+		cmd.end = MIN(start_sample + samples, end_sample);
+		cmd.offset = offset;
+		cmd.length = piece;
+		cmd.value = pd_sample_offset;
+		ret = pd_workers_command(&cmd, NULL);
+
+		start_sample += samples;
+		data += piece;
+		len -= piece;
+	}
+
+	return ret;
+#else
+	(void)start_sample;
+	(void)end_sample;
+	(void)data;
+	(void)len;
+	(void)unitsize;
+
+	return SRD_ERR;
+#endif
+}
+
+/* Have the workers complete their decoding, and write all output. */
+void pd_workers_eof(void)
+{
+#ifdef HAVE_PD_WORKERS
+	struct pd_command cmd;
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.type = PD_CMD_EOF;
+	cmd.value = pd_sample_offset;
+	pd_workers_command(&cmd, NULL);
+	if (pd_workers_sync() != SRD_OK)
+		pd_cache_discard();
+#endif
+}
+#endif
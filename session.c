@@ -27,10 +27,6 @@
 static uint64_t limit_samples = 0;
 static uint64_t limit_frames = 0;
 
-#ifdef HAVE_SRD
-extern struct srd_session *srd_sess;
-#endif
-
 static int set_limit_time(const struct sr_dev_inst *sdi)
 {
 	GVariant *gvar;
@@ -236,6 +232,31 @@ static void props_dump_details(struct df_arg_desc *args)
 		printf("Frame count: %" PRIu64 "\n", props->frame_count);
 	if (props->triggered)
 		printf("Trigger count: %" PRIu64 "\n", props->triggered);
+	printf("Counts from: %s\n",
+		props->counts_from ? props->counts_from : "full data scan");
+}
+
+/*
+ * Take the counts which the input got from its size or header, over the
+ * counts of the data which was read. The unitsize and the first analog
+ * channel are known from that data.
+ */
+static void props_apply_size_counts(struct df_arg_desc *args)
+{
+	struct input_stream_props *props;
+
+	props = &args->props;
+	if (!args->size_counts.from)
+		return;
+	if (args->size_counts.logic_bytes && props->unitsize) {
+		props->sample_count_logic =
+			args->size_counts.logic_bytes / props->unitsize;
+		props->counts_from = args->size_counts.from;
+	}
+	if (args->size_counts.analog && props->first_analog_channel) {
+		props->sample_count_analog = args->size_counts.analog;
+		props->counts_from = args->size_counts.from;
+	}
 }
 
 static void props_cleanup(struct df_arg_desc *args)
@@ -248,6 +269,454 @@ static void props_cleanup(struct df_arg_desc *args)
 	g_slist_free(props->channels);
 	props->channels = NULL;
 	props->first_analog_channel = NULL;
+	memset(&args->size_counts, 0, sizeof(args->size_counts));
+}
+
+/*
+ * Overload handling during acquisition. The datafeed callback runs in
+ * the context of the acquisition, a slow output module or decoder will
+ * stall the device until it runs out of buffer space. The time spent in
+ * the sinks gets compared to the time span which the received samples
+ * represent. When the accumulated backlog exceeds the user specified
+ * limit, packets are dropped or decimated until the sinks have caught
+ * up again. Lost samples are counted, and every gap gets reported.
+ */
+enum overload_policy {
+	OVERLOAD_BLOCK,
+	OVERLOAD_DROP,
+	OVERLOAD_DECIMATE,
+};
+
+#define OVERLOAD_DEFAULT_BACKLOG_MS	100
+
+static struct overload_state {
+	enum overload_policy policy;
+	uint64_t factor;
+	int64_t backlog_limit;
+	int64_t backlog;
+	gboolean active;
+	uint64_t phase;
+	uint64_t seen_samples;
+	uint64_t gap_start;
+	uint64_t gap_lost;
+	uint64_t gap_count;
+	uint64_t lost_dropped;
+	uint64_t lost_decimated;
+	GByteArray *buf;
+	/* Decoders missed data, they start over with the next. */
+	gboolean pd_reset;
+} overload;
+
+static int setup_overload_policy(void)
+{
+	GHashTable *args;
+	const char *policy, *val;
+	uint64_t backlog_ms;
+	int ret;
+
+	if (overload.buf)
+		g_byte_array_unref(overload.buf);
+	memset(&overload, 0, sizeof(overload));
+	overload.policy = OVERLOAD_BLOCK;
+	if (!opt_overload)
+		return SR_OK;
+
+	if (!(args = parse_generic_arg(opt_overload, TRUE, NULL))) {
+		g_critical("Invalid overload policy '%s'.", opt_overload);
+		return SR_ERR;
+	}
+
+	ret = SR_OK;
+	backlog_ms = OVERLOAD_DEFAULT_BACKLOG_MS;
+	overload.factor = 1;
+	policy = g_hash_table_lookup(args, "sigrok_key");
+	if (g_ascii_strcasecmp(policy, "block") == 0) {
+		overload.policy = OVERLOAD_BLOCK;
+	} else if (g_ascii_strcasecmp(policy, "drop") == 0) {
+		overload.policy = OVERLOAD_DROP;
+	} else if (g_ascii_strcasecmp(policy, "decimate") == 0) {
+		overload.policy = OVERLOAD_DECIMATE;
+		overload.factor = 2;
+	} else {
+		g_critical("Unknown overload policy '%s'.", policy);
+		ret = SR_ERR;
+	}
+	g_hash_table_remove(args, "sigrok_key");
+
+	if (ret == SR_OK && (val = g_hash_table_lookup(args, "factor"))) {
+		if (sr_parse_sizestring(val, &overload.factor) != SR_OK
+				|| overload.factor < 2) {
+			g_critical("Invalid decimation factor '%s'.", val);
+			ret = SR_ERR;
+		}
+		g_hash_table_remove(args, "factor");
+	}
+	if (ret == SR_OK && (val = g_hash_table_lookup(args, "backlog"))) {
+		if (sr_parse_sizestring(val, &backlog_ms) != SR_OK) {
+			g_critical("Invalid overload backlog '%s'.", val);
+			ret = SR_ERR;
+		}
+		g_hash_table_remove(args, "backlog");
+	}
+	if (ret == SR_OK && g_hash_table_size(args)) {
+		g_critical("Unknown overload policy parameter.");
+		ret = SR_ERR;
+	}
+	g_hash_table_destroy(args);
+
+	overload.backlog_limit = backlog_ms * 1000;
+
+	return ret;
+}
+
+/* Number of samples which a packet carries, or zero if not applicable. */
+static uint64_t overload_packet_samples(const struct sr_datafeed_packet *packet)
+{
+	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_analog *analog;
+
+	if (packet->type == SR_DF_LOGIC) {
+		logic = packet->payload;
+		if (!logic->unitsize)
+			return 0;
+		return logic->length / logic->unitsize;
+	}
+	if (packet->type == SR_DF_ANALOG) {
+		analog = packet->payload;
+		return analog->num_samples;
+	}
+
+	return 0;
+}
+
+/* Report the end of a gap, after the sinks have caught up. */
+static void overload_gap_end(void)
+{
+	if (!overload.gap_lost)
+		return;
+	g_warning("Overload gap at sample %" PRIu64 ": %" PRIu64
+		" samples lost.", overload.gap_start, overload.gap_lost);
+	overload.gap_count++;
+	overload.gap_lost = 0;
+}
+
+/*
+ * Logic data of a gap doesn't reach the decoders, they would take what
+ * remains for contiguous samples. The sample numbers keep counting the
+ * device's samples, the decode session gets reset before it receives
+ * data again. Returns the number of received samples after the gap.
+ */
+static uint64_t overload_skip_logic(uint64_t rcvd_samples, uint64_t count)
+{
+	rcvd_samples += count;
+	if (limit_samples && rcvd_samples > limit_samples)
+		rcvd_samples = limit_samples;
+	overload.pd_reset = TRUE;
+
+	return rcvd_samples;
+}
+
+/*
+ * Apply the overload policy to a packet before it gets passed to the
+ * sinks. Returns the packet to process (which may be a decimated copy
+ * of the original), or NULL when the packet is to be dropped.
+ */
+static const struct sr_datafeed_packet *overload_filter(
+	const struct sr_datafeed_packet *packet,
+	struct sr_datafeed_packet *dec_packet,
+	struct sr_datafeed_logic *dec_logic)
+{
+	const struct sr_datafeed_logic *logic;
+	uint64_t count, kept, idx;
+	const uint8_t *rdptr;
+
+	count = overload_packet_samples(packet);
+	if (!count)
+		return packet;
+	overload.seen_samples += count;
+
+	if (!overload.active)
+		return packet;
+
+	if (!overload.gap_lost)
+		overload.gap_start = overload.seen_samples - count;
+
+	/* Analog data is not decimated, it's dropped while overloaded. */
+	if (overload.policy == OVERLOAD_DROP || packet->type != SR_DF_LOGIC) {
+		overload.gap_lost += count;
+		overload.lost_dropped += count;
+		return NULL;
+	}
+
+	/* Keep every n-th sample, the phase spans packet boundaries. */
+	logic = packet->payload;
+	if (!overload.buf)
+		overload.buf = g_byte_array_new();
+	g_byte_array_set_size(overload.buf, 0);
+	rdptr = logic->data;
+	kept = 0;
+	for (idx = 0; idx < count; idx++) {
+		if (overload.phase == 0) {
+			g_byte_array_append(overload.buf,
+				&rdptr[idx * logic->unitsize], logic->unitsize);
+			kept++;
+		}
+		if (++overload.phase == overload.factor)
+			overload.phase = 0;
+	}
+	overload.gap_lost += count - kept;
+	overload.lost_decimated += count - kept;
+	if (!kept)
+		return NULL;
+
+	dec_logic->length = kept * logic->unitsize;
+	dec_logic->unitsize = logic->unitsize;
+	dec_logic->data = overload.buf->data;
+	dec_packet->type = SR_DF_LOGIC;
+	dec_packet->payload = dec_logic;
+
+	return dec_packet;
+}
+
+/*
+ * Account the time which was spent in the sinks for a number of samples
+ * against the time span which these samples represent. Enter or leave
+ * the overloaded state (with hysteresis) depending on the backlog.
+ */
+static void overload_account(uint64_t count, uint64_t samplerate,
+	int64_t spent_us)
+{
+	int64_t budget_us;
+
+	if (!count || !samplerate)
+		return;
+
+	budget_us = (int64_t)(count * G_USEC_PER_SEC / samplerate);
+	overload.backlog += spent_us - budget_us;
+	if (overload.backlog < 0)
+		overload.backlog = 0;
+
+	if (!overload.active && overload.backlog > overload.backlog_limit) {
+		g_debug("cli: Sinks fell behind by %" PRIi64 " ms.",
+			overload.backlog / 1000);
+		overload.active = TRUE;
+		overload.phase = 0;
+	} else if (overload.active
+			&& overload.backlog <= overload.backlog_limit / 2) {
+		overload.active = FALSE;
+		overload_gap_end();
+	}
+}
+
+static void overload_summary(void)
+{
+	uint64_t lost;
+
+	overload_gap_end();
+	lost = overload.lost_dropped + overload.lost_decimated;
+	if (!lost)
+		return;
+	g_warning("Overload: %" PRIu64 " of %" PRIu64 " samples lost in %"
+		PRIu64 " gap(s) (%" PRIu64 " dropped, %" PRIu64 " decimated).",
+		lost, overload.seen_samples, overload.gap_count,
+		overload.lost_dropped, overload.lost_decimated);
+}
+
+/*
+ * Sample range extraction from input files (--from/--to). The range is
+ * specified in samples, or as a time (s, ms, us, ns) which needs the
+ * samplerate and thus gets resolved when the first data arrives. Data
+ * before the range is discarded, the first and last packets are cut at
+ * the range's edges. Readers which can skip data without parsing it
+ * report the skipped samples, and stop reading when the range is done.
+ */
+static struct sample_window {
+	gboolean active;
+	gboolean has_to;
+	double from_value, to_value;
+	uint64_t from_scale, to_scale;
+	gboolean resolved;
+	uint64_t from, to;
+	uint64_t logic_pos, analog_pos;
+	gboolean done;
+} window;
+
+/* Parse a sample number, or a time with a unit (scale per second). */
+static int window_parse(const char *spec, double *value, uint64_t *scale)
+{
+	char *end;
+
+	*value = g_ascii_strtod(spec, &end);
+	if (end == spec || *value < 0)
+		return SR_ERR;
+	while (*end == ' ')
+		end++;
+	if (!*end)
+		*scale = 0;
+	else if (g_ascii_strcasecmp(end, "s") == 0)
+		*scale = 1;
+	else if (g_ascii_strcasecmp(end, "ms") == 0)
+		*scale = 1000;
+	else if (g_ascii_strcasecmp(end, "us") == 0)
+		*scale = 1000000;
+	else if (g_ascii_strcasecmp(end, "ns") == 0)
+		*scale = 1000000000;
+	else
+		return SR_ERR;
+	if (!*scale && *value != (double)(uint64_t)*value)
+		return SR_ERR;
+
+	return SR_OK;
+}
+
+int setup_sample_window(void)
+{
+	memset(&window, 0, sizeof(window));
+	window.to = UINT64_MAX;
+#ifdef HAVE_SRD
+	pd_sample_offset = 0;
+#endif
+	if (!opt_from && !opt_to)
+		return SR_OK;
+
+	if (opt_from && window_parse(opt_from, &window.from_value,
+			&window.from_scale) != SR_OK) {
+		g_critical("Invalid range start '%s'.", opt_from);
+		return SR_ERR;
+	}
+	if (opt_to && window_parse(opt_to, &window.to_value,
+			&window.to_scale) != SR_OK) {
+		g_critical("Invalid range end '%s'.", opt_to);
+		return SR_ERR;
+	}
+	window.has_to = opt_to != NULL;
+	window.active = TRUE;
+
+	return SR_OK;
+}
+
+static uint64_t window_samples(double value, uint64_t scale,
+	uint64_t samplerate)
+{
+	if (!scale)
+		return value;
+
+	return value * samplerate / scale + 0.5;
+}
+
+static int window_resolve(uint64_t samplerate)
+{
+	if ((window.from_scale || window.to_scale) && !samplerate) {
+		g_critical("A time range needs the input's samplerate.");
+		return SR_ERR;
+	}
+	window.from = window_samples(window.from_value, window.from_scale,
+		samplerate);
+	if (window.has_to)
+		window.to = window_samples(window.to_value, window.to_scale,
+			samplerate);
+	if (window.to <= window.from) {
+		g_critical("The sample range is empty.");
+		return SR_ERR;
+	}
+	window.resolved = TRUE;
+	g_debug("cli: Sample range %" PRIu64 "-%" PRIu64 ".",
+		window.from, window.to);
+
+#ifdef HAVE_SRD
+	/* Decoders see the range's first sample as sample 0. */
+	pd_sample_offset = window.from;
+#endif
+
+	return SR_OK;
+}
+
+gboolean sample_window_active(void)
+{
+	return window.active;
+}
+
+gboolean sample_window_done(void)
+{
+	return window.active && window.done;
+}
+
+/*
+ * Get the range in samples, for readers which can skip data. The end is
+ * UINT64_MAX when the range is open.
+ */
+int sample_window_range(uint64_t samplerate, uint64_t *from, uint64_t *to)
+{
+	if (!window.resolved && window_resolve(samplerate) != SR_OK)
+		return SR_ERR;
+	*from = window.from;
+	*to = window.to;
+
+	return SR_OK;
+}
+
+/* Account logic samples which a reader skipped without sending them. */
+void sample_window_skip(uint64_t count)
+{
+	window.logic_pos += count;
+}
+
+/*
+ * Cut a packet to the sample range. Returns the packet to process
+ * (which may refer to part of the original data), or NULL when the
+ * packet is outside of the range.
+ */
+static const struct sr_datafeed_packet *window_filter(
+	const struct sr_datafeed_packet *packet, uint64_t samplerate,
+	struct sr_datafeed_packet *win_packet,
+	struct sr_datafeed_logic *win_logic,
+	struct sr_datafeed_analog *win_analog)
+{
+	const struct sr_datafeed_logic *logic;
+	const struct sr_datafeed_analog *analog;
+	uint64_t count, start, skip, keep, *pos;
+	size_t unit;
+
+	count = overload_packet_samples(packet);
+	if (!count)
+		return packet;
+	if (!window.resolved && window_resolve(samplerate) != SR_OK)
+		return NULL;
+
+	pos = packet->type == SR_DF_LOGIC ? &window.logic_pos : &window.analog_pos;
+	start = *pos;
+	*pos += count;
+	if (start + count <= window.from)
+		return NULL;
+	if (start + count >= window.to)
+		window.done = TRUE;
+	if (start >= window.to)
+		return NULL;
+
+	skip = window.from > start ? window.from - start : 0;
+	keep = MIN(start + count, window.to) - start - skip;
+	if (!skip && keep == count)
+		return packet;
+
+	win_packet->type = packet->type;
+	if (packet->type == SR_DF_LOGIC) {
+		logic = packet->payload;
+		*win_logic = *logic;
+		win_logic->data = (uint8_t *)logic->data + skip * logic->unitsize;
+		win_logic->length = keep * logic->unitsize;
+		win_packet->payload = win_logic;
+	} else {
+		analog = packet->payload;
+		unit = analog->encoding->unitsize;
+		if (analog->meaning->channels)
+			unit *= g_slist_length(analog->meaning->channels);
+		*win_analog = *analog;
+		win_analog->data = (uint8_t *)analog->data + skip * unit;
+		win_analog->num_samples = keep;
+		win_packet->payload = win_analog;
+	}
+
+	return win_packet;
 }
 
 void datafeed_in(const struct sr_dev_inst *sdi,
@@ -257,6 +726,7 @@ void datafeed_in(const struct sr_dev_inst *sdi,
 	static const struct sr_output *oa = NULL;
 	static uint64_t rcvd_samples_logic = 0;
 	static uint64_t rcvd_samples_analog = 0;
+	static uint64_t pd_first_sample = 0;
 	static uint64_t samplerate = 0;
 	static int triggered = 0;
 	static FILE *outfile = NULL;
@@ -275,10 +745,20 @@ void datafeed_in(const struct sr_dev_inst *sdi,
 	uint64_t end_sample;
 	uint64_t input_len;
 	struct sr_dev_driver *driver;
+	struct sr_datafeed_packet dec_packet;
+	struct sr_datafeed_logic dec_logic;
+	struct sr_datafeed_packet win_packet;
+	struct sr_datafeed_logic win_logic;
+	struct sr_datafeed_analog win_analog;
+	uint64_t overload_count;
+	int64_t overload_start;
+	gboolean overload_gap;
+	gboolean window_done;
 
 	/* Avoid warnings when building without decoder support. */
 	(void)session;
 	(void)input_len;
+	(void)pd_first_sample;
 
 	driver = sr_dev_inst_driver_get(sdi);
 
@@ -292,6 +772,35 @@ void datafeed_in(const struct sr_dev_inst *sdi,
 	do_props = df_arg->do_props;
 	props = &df_arg->props;
 
+	/* Shed load when the sinks can't keep up with the acquisition. */
+	overload_count = 0;
+	overload_start = 0;
+	overload_gap = FALSE;
+	if (!do_props && overload.policy != OVERLOAD_BLOCK) {
+		overload_count = overload_packet_samples(packet);
+		overload_gap = overload.active && packet->type == SR_DF_LOGIC;
+		packet = overload_filter(packet, &dec_packet, &dec_logic);
+		if (!packet) {
+			if (overload_gap && !(opt_wait_trigger && !triggered))
+				rcvd_samples_logic = overload_skip_logic(
+					rcvd_samples_logic, overload_count);
+			overload_account(overload_count, samplerate, 0);
+			return;
+		}
+		overload_start = g_get_monotonic_time();
+	}
+
+	/* Only pass on the requested sample range. */
+	if (!do_props && window.active) {
+		window_done = window.done;
+		packet = window_filter(packet, samplerate, &win_packet,
+			&win_logic, &win_analog);
+		if (window.done && !window_done && df_arg->stoppable)
+			sr_session_stop(session);
+		if (!packet)
+			return;
+	}
+
 	switch (packet->type) {
 	case SR_DF_HEADER:
 		g_debug("cli: Received SR_DF_HEADER.");
@@ -319,18 +828,17 @@ void datafeed_in(const struct sr_dev_inst *sdi,
 					sdi, NULL);
 
 		rcvd_samples_logic = rcvd_samples_analog = 0;
+		pd_first_sample = 0;
 
 #ifdef HAVE_SRD
 		if (opt_pds) {
 			if (samplerate) {
-				if (srd_session_metadata_set(srd_sess, SRD_CONF_SAMPLERATE,
-						g_variant_new_uint64(samplerate)) != SRD_OK) {
+				if (pd_session_samplerate(samplerate) != SRD_OK) {
 					g_critical("Failed to configure decode session.");
 					break;
 				}
-				pd_samplerate = samplerate;
 			}
-			if (srd_session_start(srd_sess) != SRD_OK) {
+			if (pd_session_start() != SRD_OK) {
 				g_critical("Failed to start decode session.");
 				break;
 			}
@@ -353,11 +861,8 @@ void datafeed_in(const struct sr_dev_inst *sdi,
 				}
 #ifdef HAVE_SRD
 				if (opt_pds) {
-					if (srd_session_metadata_set(srd_sess, SRD_CONF_SAMPLERATE,
-							g_variant_new_uint64(samplerate)) != SRD_OK) {
+					if (pd_session_samplerate(samplerate) != SRD_OK)
 						g_critical("Failed to pass samplerate to decoder.");
-					}
-					pd_samplerate = samplerate;
 				}
 #endif
 				break;
@@ -406,6 +911,12 @@ void datafeed_in(const struct sr_dev_inst *sdi,
 		if (limit_samples && rcvd_samples_logic >= limit_samples)
 			break;
 
+		if (overload_gap) {
+			rcvd_samples_logic = overload_skip_logic(
+				rcvd_samples_logic, overload_count);
+			break;
+		}
+
 		end_sample = rcvd_samples_logic + logic->length / logic->unitsize;
 		/* Cut off last packet according to the sample limit. */
 		if (limit_samples && end_sample > limit_samples)
@@ -414,8 +925,17 @@ void datafeed_in(const struct sr_dev_inst *sdi,
 
 		if (opt_pds) {
 #ifdef HAVE_SRD
-			if (srd_session_send(srd_sess, rcvd_samples_logic, end_sample,
-					logic->data, input_len, logic->unitsize) != SRD_OK)
+			/* Decoders count from zero again, after a gap. */
+			if (overload.pd_reset) {
+				overload.pd_reset = FALSE;
+				if (pd_session_reset(rcvd_samples_logic
+						- pd_first_sample) != SRD_OK)
+					sr_session_stop(session);
+				pd_first_sample = rcvd_samples_logic;
+			}
+			if (pd_session_send(rcvd_samples_logic - pd_first_sample,
+					end_sample - pd_first_sample, logic->data,
+					input_len, logic->unitsize) != SRD_OK)
 				sr_session_stop(session);
 #endif
 		}
@@ -478,6 +998,10 @@ void datafeed_in(const struct sr_dev_inst *sdi,
 		}
 	}
 
+	if (overload_start)
+		overload_account(overload_count, samplerate,
+			g_get_monotonic_time() - overload_start);
+
 	/*
 	 * SR_DF_END needs to be handled after the output module's receive()
 	 * is called, so it can properly clean up that module.
@@ -485,11 +1009,13 @@ void datafeed_in(const struct sr_dev_inst *sdi,
 	if (packet->type == SR_DF_END) {
 		g_debug("cli: Received SR_DF_END.");
 
-#if defined HAVE_SRD_SESSION_SEND_EOF && HAVE_SRD_SESSION_SEND_EOF
-		(void)srd_session_send_eof(srd_sess);
+#ifdef HAVE_SRD
+		if (opt_pds)
+			pd_session_eof();
 #endif
 
 		if (do_props) {
+			props_apply_size_counts(df_arg);
 			props_dump_details(df_arg);
 			props_cleanup(df_arg);
 			o = NULL;
@@ -506,6 +1032,9 @@ void datafeed_in(const struct sr_dev_inst *sdi,
 		if (outfile && outfile != stdout)
 			fclose(outfile);
 
+		if (overload.policy != OVERLOAD_BLOCK)
+			overload_summary();
+
 		if (limit_samples) {
 			if (rcvd_samples_logic > 0 && rcvd_samples_logic < limit_samples)
 				g_warning("Device only sent %" PRIu64 " samples.",
@@ -883,6 +1412,11 @@ void run_session(void)
 		}
 	}
 
+	if (setup_overload_policy() != SR_OK) {
+		sr_session_destroy(session);
+		return;
+	}
+
 	if (opt_transform_module) {
 		if (!(t = setup_transform_module(sdi)))
 			g_critical("Failed to initialize transform module.");
@@ -31,6 +31,10 @@
 
 /* main.c */
 extern struct sr_context *sr_ctx;
+#ifdef HAVE_SRD
+int pd_session_setup(void);
+int pd_session_renew(void);
+#endif
 int select_channels(struct sr_dev_inst *sdi);
 int maybe_config_get(struct sr_dev_driver *driver,
 		const struct sr_dev_inst *sdi, struct sr_channel_group *cg,
@@ -62,6 +66,7 @@ struct sr_channel_group *lookup_channel_group(struct sr_dev_inst *sdi,
 /* session.c */
 struct df_arg_desc {
 	struct sr_session *session;
+	gboolean stoppable;
 	int do_props;
 	struct input_stream_props {
 		uint64_t samplerate;
@@ -72,7 +77,14 @@ struct df_arg_desc {
 		uint64_t sample_count_analog;
 		uint64_t frame_count;
 		uint64_t triggered;
+		const char *counts_from;
 	} props;
+	/* Counts the input knows without reading all data, see input.c. */
+	struct {
+		const char *from;
+		uint64_t logic_bytes;
+		uint64_t analog;
+	} size_counts;
 };
 void datafeed_in(const struct sr_dev_inst *sdi,
 		const struct sr_datafeed_packet *packet, void *cb_data);
@@ -80,16 +92,103 @@ int opt_to_gvar(char *key, char *value, struct sr_config *src);
 int set_dev_options_array(struct sr_dev_inst *sdi, char **opts);
 int set_dev_options(struct sr_dev_inst *sdi, GHashTable *args);
 void run_session(void);
+int setup_sample_window(void);
+gboolean sample_window_active(void);
+gboolean sample_window_done(void);
+int sample_window_range(uint64_t samplerate, uint64_t *from, uint64_t *to);
+void sample_window_skip(uint64_t count);
 
 /* input.c */
 void load_input_file(gboolean do_props);
 
+/* srzip.c */
+#ifdef HAVE_LIBZIP
+struct zip;
+struct srzip_chunk {
+	uint64_t index;
+	uint64_t number;
+	uint64_t offset;
+	uint64_t size;
+	uint64_t comp_size;
+	uint64_t first_sample;
+	uint64_t samples;
+	/* Activity summary, for up to 64 channels. */
+	gboolean has_activity;
+	uint64_t toggles;
+	uint64_t first_value;
+	uint64_t last_value;
+};
+struct srzip {
+	char *path;
+	struct zip *archive;
+	uint64_t file_size;
+	int64_t file_mtime;
+	gboolean indexed;
+	uint64_t samplerate;
+	unsigned int unitsize;
+	GArray *chunks;
+	uint64_t total_samples;
+};
+int srzip_open(const char *path, struct srzip **out);
+void srzip_close(struct srzip *zs);
+int srzip_chunk_read(struct zip *archive, const struct srzip_chunk *chunk,
+	uint8_t *buf);
+int srzip_feed(struct srzip *zs, const struct sr_dev_inst *sdi,
+	struct df_arg_desc *df_arg);
+void srzip_props(struct srzip *zs, const struct sr_dev_inst *sdi,
+	struct df_arg_desc *df_arg);
+#endif
+
+/* decompress.c */
+struct decompressor;
+struct decompressor *decompressor_open(int fd, const char *path);
+gssize decompressor_read(struct decompressor *dc, void *buf, size_t count);
+const char *decompressor_error(const struct decompressor *dc);
+void decompressor_free(struct decompressor *dc);
+
+/* cache.c */
+struct input_cache;
+gchar *cache_path(const char *kind, const char *key);
+gchar *cache_file_key(const char *path, const char *params);
+struct input_cache *input_cache_new(const char *key);
+void input_cache_packet(const struct sr_dev_inst *sdi,
+	const struct sr_datafeed_packet *packet, void *cb_data);
+void input_cache_close(struct input_cache *ic, gboolean complete);
+int input_cache_replay(const char *key, struct df_arg_desc *df_arg);
+struct input_cache *input_cache_new_buffer(void);
+GByteArray *input_cache_take_buffer(struct input_cache *ic);
+void input_cache_append(struct input_cache *ic, const GByteArray *records);
+struct cache_replay;
+struct cache_replay *cache_replay_new(void);
+int cache_replay_buffer(struct cache_replay *cr, const GByteArray *records,
+	struct df_arg_desc *df_arg);
+void cache_replay_finish(struct cache_replay *cr, struct df_arg_desc *df_arg);
+
+/* split.c */
+int split_load_input(const struct sr_input_module *imod,
+	GHashTable *mod_opts, int fd, struct input_cache *cache,
+	struct df_arg_desc *df_arg);
+
+/* batch.c */
+gchar **batch_expand_inputs(gchar **args);
+void batch_run(gboolean do_props);
+
 /* output.c */
 int setup_binary_stdout(void);
+#ifdef HAVE_SRD
+int setup_output_flush(void);
+#endif
+void output_flush_check(void);
+void output_write(const void *data, size_t len);
+void output_flush(void);
 
 /* decode.c */
 #ifdef HAVE_SRD
 extern uint64_t pd_samplerate;
+extern uint64_t pd_sample_offset;
+extern uint64_t pd_input_mask;
+extern uint64_t pd_output_from;
+extern uint64_t pd_output_to;
 int register_pds(gchar **all_pds, char *opt_pd_annotations);
 int setup_pd_annotations(char *opt_pd_annotations);
 int setup_pd_meta(char *opt_pd_meta);
@@ -99,7 +198,70 @@ void show_pd_meta(struct srd_proto_data *pdata, void *cb_data);
 void show_pd_binary(struct srd_proto_data *pdata, void *cb_data);
 void show_pd_prepare(void);
 void show_pd_close(void);
+void map_pd_channel_list(GSList *channels);
 void map_pd_channels(struct sr_dev_inst *sdi);
+uint64_t pd_same_samples(const uint8_t *data, uint64_t count, int unitsize,
+	uint64_t mask, uint64_t value);
+uint64_t pd_abs_sample(uint64_t snum);
+int pd_session_feed(uint64_t start_sample, uint64_t end_sample,
+	const uint8_t *data, uint64_t len, int unitsize);
+int pd_session_samplerate(uint64_t samplerate);
+int pd_session_start(void);
+int pd_session_reset(uint64_t samples);
+int pd_session_send(uint64_t start_sample, uint64_t end_sample,
+	const uint8_t *data, uint64_t len, int unitsize);
+void pd_session_eof(void);
+#endif
+
+/* pdworker.c */
+#ifdef HAVE_SRD
+void pd_workers_start(void);
+void pd_workers_stop(void);
+gboolean pd_workers_active(void);
+gboolean pd_worker_output(uint64_t start_sample, const void *data, size_t len);
+gboolean pd_workers_channels(GSList *channels);
+int pd_workers_samplerate(uint64_t samplerate);
+int pd_workers_session_start(void);
+int pd_workers_reset(void);
+int pd_workers_send(uint64_t start_sample, uint64_t end_sample,
+	const uint8_t *data, uint64_t len, int unitsize);
+void pd_workers_eof(void);
+#endif
+
+/* pdsplit.c */
+#ifdef HAVE_SRD
+gboolean pd_split_active(void);
+void pd_split_start(void);
+int pd_split_spool(uint64_t start_sample, uint64_t end_sample,
+	const uint8_t *data, uint64_t len, int unitsize);
+void pd_split_run(void);
+#endif
+
+/* pdsqlite.c */
+#ifdef HAVE_SRD
+void pd_sqlite_open(const char *path);
+void pd_sqlite_annotation(struct srd_proto_data *pdata);
+void pd_sqlite_meta(struct srd_proto_data *pdata);
+void pd_sqlite_binary(struct srd_proto_data *pdata);
+void pd_sqlite_close(void);
+#endif
+
+/* pdprofile.c */
+#ifdef HAVE_SRD
+int pd_profile_callback_add(struct srd_session *sess, int output_type,
+	srd_pd_output_callback cb, void *cb_data);
+void pd_profile_begin(void);
+void pd_profile_end(uint64_t samples);
+void pd_profile_session_reset(void);
+void pd_profile_report(void);
+#endif
+
+/* pdcache.c */
+#ifdef HAVE_SRD
+gboolean pd_cache_replay(void);
+void pd_cache_put(const void *data, size_t len);
+void pd_cache_discard(void);
+void pd_cache_finish(void);
 #endif
 
 /* parsers.c */
@@ -130,6 +292,11 @@ extern gboolean opt_scan_devs;
 extern gboolean opt_dont_scan;
 extern gboolean opt_wait_trigger;
 extern gchar *opt_input_file;
+extern gboolean opt_stream;
+extern gboolean opt_cache;
+extern gboolean opt_follow;
+extern gchar *opt_follow_timeout;
+extern gchar **opt_input_files;
 extern gchar *opt_output_file;
 extern gchar *opt_drv;
 extern gchar **opt_configs;
@@ -144,6 +311,14 @@ extern gchar *opt_pd_binary;
 extern gboolean opt_pd_ann_class;
 extern gboolean opt_pd_samplenum;
 extern gboolean opt_pd_jsontrace;
+extern gboolean opt_pd_records;
+extern gchar *opt_pd_sqlite;
+extern gboolean opt_pd_profile;
+extern gchar *opt_pd_elide;
+extern gboolean opt_pd_cache;
+extern gboolean opt_pd_split;
+extern gchar *opt_pd_overlap;
+extern gchar *opt_pd_flush;
 #endif
 extern gchar *opt_input_format;
 extern gchar *opt_output_format;
@@ -153,6 +328,10 @@ extern gchar *opt_time;
 extern gchar *opt_samples;
 extern gchar *opt_frames;
 extern gboolean opt_continuous;
+extern gchar *opt_overload;
+extern gchar *opt_from;
+extern gchar *opt_to;
+extern gint opt_jobs;
 extern gchar **opt_gets;
 extern gboolean opt_set;
 extern gboolean opt_list_serial;
@@ -0,0 +1,334 @@
+/*
+ * This file is part of the sigrok-cli project.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#include <string.h>
+#include <glib.h>
+#include "sigrok-cli.h"
+
+/*
+ * Parallel parsing of large CSV files. The file gets split at line
+ * boundaries into slabs, and every slab is parsed by an input module
+ * instance of its own on a worker thread. The packets which an instance
+ * sends are kept as in-memory cache records (see cache.c), and get
+ * replayed strictly in the slab order.
+ *
+ * The lines before the first data line (comments, the header line) are
+ * located once, and get prepended to every slab. So that all instances
+ * see the same channel setup.
+ *
+ * Other text formats carry state from line to line (VCD only lists
+ * changes), they can't be split this way.
+ */
+#define SPLIT_SLAB_SIZE		(32 * 1024 * 1024)
+#define SPLIT_MIN_SIZE		(4 * SPLIT_SLAB_SIZE)
+
+struct split_slot {
+	const struct sr_input *in;
+	struct sr_session *session;
+	uint64_t offset;
+	size_t length;
+	GByteArray *records;
+	int status;
+	gboolean done;
+};
+
+struct split_parser {
+	const char *map;
+	uint64_t size;
+	size_t prefix_len;
+	GThreadPool *pool;
+	GMutex mutex;
+	GCond cond;
+	struct split_slot *slots;
+	guint depth;
+	guint next_submit;
+	guint next_deliver;
+	uint64_t submit_pos;
+};
+
+/* Share the processors among the files which get processed in parallel. */
+static guint split_threads(void)
+{
+	guint threads;
+
+	threads = g_get_num_processors() / MAX(opt_jobs, 1);
+
+	return MAX(threads, 1);
+}
+
+/* Look up an option, newer libsigrok versions renamed some. */
+static GVariant *split_opt(GHashTable *opts, const char *key,
+	const char *old_key, const GVariantType *type)
+{
+	GVariant *var;
+
+	if (!opts)
+		return NULL;
+	if (!(var = g_hash_table_lookup(opts, key)) && old_key)
+		var = g_hash_table_lookup(opts, old_key);
+	if (!var || !g_variant_is_of_type(var, type))
+		return NULL;
+
+	return var;
+}
+
+/*
+ * Find the first data line, the same way as the CSV input module does:
+ * lines before the start line are ignored, as are comments and empty
+ * lines. The header line (when enabled) precedes the data.
+ */
+static gboolean split_find_data(struct split_parser *sp, GHashTable *opts)
+{
+	GVariant *var;
+	const char *line, *eol, *comment;
+	uint64_t start_line, line_nr, pos;
+	size_t len, comment_len;
+	gboolean header;
+
+	start_line = 1;
+	if ((var = split_opt(opts, "start_line", "startline", G_VARIANT_TYPE_UINT32)))
+		start_line = g_variant_get_uint32(var);
+	header = FALSE;
+	if ((var = split_opt(opts, "header", NULL, G_VARIANT_TYPE_BOOLEAN)))
+		header = g_variant_get_boolean(var);
+	comment = ";";
+	if ((var = split_opt(opts, "comment_leader", "comment-leader",
+			G_VARIANT_TYPE_STRING)))
+		comment = g_variant_get_string(var, NULL);
+	comment_len = strlen(comment);
+
+	pos = 0;
+	for (line_nr = 1; pos < sp->size; line_nr++) {
+		line = &sp->map[pos];
+		eol = memchr(line, '\n', MIN(sp->size - pos, SPLIT_SLAB_SIZE));
+		if (!eol)
+			return FALSE;
+		len = eol - line;
+		while (len && g_ascii_isspace(line[len - 1]))
+			len--;
+		if (line_nr >= start_line && len
+				&& (!comment_len || len < comment_len
+				|| memcmp(line, comment, comment_len) != 0)) {
+			if (!header)
+				break;
+			header = FALSE;
+		}
+		pos = eol - sp->map + 1;
+	}
+	sp->prefix_len = pos;
+
+	return pos < sp->size;
+}
+
+static void split_parse(gpointer data, gpointer user_data)
+{
+	struct split_parser *sp;
+	struct split_slot *slot;
+	struct sr_dev_inst *sdi;
+	struct input_cache *ic;
+	GString *text;
+	int status;
+
+	slot = data;
+	sp = user_data;
+
+	text = g_string_sized_new(sp->prefix_len + slot->length + 1);
+	g_string_append_len(text, sp->map, sp->prefix_len);
+	g_string_append_len(text, &sp->map[slot->offset], slot->length);
+
+	ic = input_cache_new_buffer();
+	sr_session_datafeed_callback_add(slot->session, input_cache_packet, ic);
+	status = sr_input_send(slot->in, text);
+	if (status == SR_OK && (sdi = sr_input_dev_inst_get(slot->in))) {
+		/* The first call may only have set up the device. */
+		status = sr_session_dev_add(slot->session, sdi);
+		g_string_truncate(text, 0);
+		if (status == SR_OK)
+			status = sr_input_send(slot->in, text);
+	}
+	if (status == SR_OK)
+		status = sr_input_end(slot->in);
+	slot->records = input_cache_take_buffer(ic);
+	g_string_free(text, TRUE);
+
+	g_mutex_lock(&sp->mutex);
+	slot->status = status;
+	slot->done = TRUE;
+	g_cond_broadcast(&sp->cond);
+	g_mutex_unlock(&sp->mutex);
+}
+
+/* Release a delivered slot's resources, in the main thread. */
+static void split_slot_clear(struct split_slot *slot)
+{
+	if (slot->in)
+		sr_input_free(slot->in);
+	slot->in = NULL;
+	if (slot->session)
+		sr_session_destroy(slot->session);
+	slot->session = NULL;
+	if (slot->records)
+		g_byte_array_free(slot->records, TRUE);
+	slot->records = NULL;
+}
+
+/*
+ * Get the next slab's packets. Returns NULL after the last slab. Input
+ * module instances and sessions get created here, in the main thread.
+ */
+static struct split_slot *split_next(struct split_parser *sp,
+	const struct sr_input_module *imod, GHashTable *mod_opts)
+{
+	struct split_slot *slot;
+	const char *eol;
+	uint64_t end;
+
+	if (sp->next_deliver > 0)
+		split_slot_clear(&sp->slots[(sp->next_deliver - 1) % sp->depth]);
+
+	while (sp->submit_pos < sp->size
+			&& sp->next_submit - sp->next_deliver < sp->depth) {
+		slot = &sp->slots[sp->next_submit % sp->depth];
+		end = MIN(sp->submit_pos + SPLIT_SLAB_SIZE, sp->size);
+		if (end < sp->size) {
+			eol = memchr(&sp->map[end], '\n', sp->size - end);
+			end = eol ? (uint64_t)(eol - sp->map) + 1 : sp->size;
+		}
+		slot->offset = sp->submit_pos;
+		slot->length = end - sp->submit_pos;
+		sp->submit_pos = end;
+		if (!(slot->in = sr_input_new(imod, mod_opts)))
+			g_critical("Error: failed to initialize input module.");
+		sr_session_new(sr_ctx, &slot->session);
+		slot->done = FALSE;
+		sp->next_submit++;
+		g_thread_pool_push(sp->pool, slot, NULL);
+	}
+	if (sp->next_deliver == sp->next_submit)
+		return NULL;
+
+	slot = &sp->slots[sp->next_deliver % sp->depth];
+	g_mutex_lock(&sp->mutex);
+	while (!slot->done)
+		g_cond_wait(&sp->cond, &sp->mutex);
+	g_mutex_unlock(&sp->mutex);
+	sp->next_deliver++;
+
+	return slot;
+}
+
+/*
+ * Parse a CSV file in parallel, when that is worthwhile. Returns
+ * SR_ERR_NA when the file should be read sequentially instead. The
+ * packets also get stored in the input cache, when one is given.
+ */
+int split_load_input(const struct sr_input_module *imod,
+	GHashTable *mod_opts, int fd, struct input_cache *cache,
+	struct df_arg_desc *df_arg)
+{
+#ifdef HAVE_SYS_MMAN_H
+	struct split_parser sp;
+	struct split_slot *slot;
+	struct cache_replay *cr;
+	struct stat st;
+	const char *id;
+	void *map;
+	guint threads, idx;
+	gboolean ok;
+
+	id = sr_input_id_get(imod);
+	if (!id || strcmp(id, "csv") != 0)
+		return SR_ERR_NA;
+	threads = split_threads();
+	if (threads < 2)
+		return SR_ERR_NA;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)
+			|| (uint64_t)st.st_size < SPLIT_MIN_SIZE
+			|| (uint64_t)st.st_size > SIZE_MAX)
+		return SR_ERR_NA;
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
+		return SR_ERR_NA;
+#ifdef HAVE_POSIX_MADVISE
+	(void)posix_madvise(map, st.st_size, POSIX_MADV_SEQUENTIAL);
+#endif
+
+	memset(&sp, 0, sizeof(sp));
+	sp.map = map;
+	sp.size = st.st_size;
+	if (!split_find_data(&sp, mod_opts)) {
+		munmap(map, st.st_size);
+		return SR_ERR_NA;
+	}
+	sp.submit_pos = sp.prefix_len;
+	sp.depth = 2 * threads;
+	sp.slots = g_malloc0(sp.depth * sizeof(*sp.slots));
+	g_mutex_init(&sp.mutex);
+	g_cond_init(&sp.cond);
+	sp.pool = g_thread_pool_new(split_parse, &sp, threads, TRUE, NULL);
+	g_debug("cli: Parsing %s with %u threads, in slabs of %d MiB.",
+		opt_input_file, threads, SPLIT_SLAB_SIZE / (1024 * 1024));
+
+	cr = cache_replay_new();
+	ok = TRUE;
+	while (ok && !sample_window_done()
+			&& (slot = split_next(&sp, imod, mod_opts))) {
+		if (slot->status != SR_OK) {
+			g_critical("File import failed (read)");
+			ok = FALSE;
+			break;
+		}
+		if (cache)
+			input_cache_append(cache, slot->records);
+		if (cache_replay_buffer(cr, slot->records, df_arg) != SR_OK) {
+			g_critical("File import failed (packets)");
+			ok = FALSE;
+		}
+	}
+	cache_replay_finish(cr, df_arg);
+	if (cache)
+		input_cache_close(cache, ok && sp.submit_pos == sp.size
+			&& sp.next_deliver == sp.next_submit);
+
+	/* Wait for slabs in flight, drop the queued ones. */
+	g_thread_pool_free(sp.pool, TRUE, TRUE);
+	for (idx = 0; idx < sp.depth; idx++)
+		split_slot_clear(&sp.slots[idx]);
+	g_free(sp.slots);
+	g_mutex_clear(&sp.mutex);
+	g_cond_clear(&sp.cond);
+	munmap(map, st.st_size);
+
+	return SR_OK;
+#else
+	(void)imod;
+	(void)mod_opts;
+	(void)fd;
+	(void)cache;
+	(void)df_arg;
+
+	return SR_ERR_NA;
+#endif
+}
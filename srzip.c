@@ -0,0 +1,861 @@
+/*
+ * This file is part of the sigrok-cli project.
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#ifdef HAVE_LIBZIP
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <zip.h>
+#include "sigrok-cli.h"
+
+/*
+ * Direct access to the logic data in sigrok session files (srzip). The
+ * session file is a zip archive, the logic data is kept in a sequence
+ * of entries (logic-1-1, logic-1-2, ...). The size of each entry is
+ * known from the archive's directory, so the sample range which every
+ * entry covers is known without decompressing anything. This allows
+ * to skip entries which are not of interest.
+ *
+ * The device instance still gets created by libsigrok's session file
+ * support, only the data is read here and gets sent to the datafeed
+ * callback directly.
+ *
+ * After a complete pass over a file, an index gets stored next to it
+ * (<file>.idx), and gets used as long as the file doesn't change. The
+ * index is a text file, one item per line:
+ *
+ *   sigrok-cli-index 1
+ *   source <file size> <file mtime>
+ *   samplerate <samplerate>
+ *   unitsize <unitsize>
+ *   samples <total samples>
+ *   chunk <number> <entry> <first sample> <samples> <offset> <size>
+ *         <compressed size> <toggles> <first value> <last value>
+ *
+ * Chunk lines are in sample order. <entry> is the zip entry's index,
+ * <offset> is the byte offset of the entry's compressed data in the
+ * file (the data is deflated, or stored). The activity summary is
+ * given by the last three (hex) fields: the mask of channels which
+ * change within the chunk, and the chunk's first and last sample
+ * value. It is "-" for files with more than 64 channels.
+ */
+
+#define INDEX_SUFFIX		".idx"
+#define INDEX_MAGIC		"sigrok-cli-index"
+#define INDEX_VERSION		1
+
+/* Zip file structure signatures and sizes. */
+#define ZIP_EOCD_SIG		0x06054b50
+#define ZIP_EOCD_SIZE		22
+#define ZIP_EOCD64_LOC_SIG	0x07064b50
+#define ZIP_EOCD64_LOC_SIZE	20
+#define ZIP_EOCD64_SIG		0x06064b50
+#define ZIP_EOCD64_SIZE		56
+#define ZIP_CDIR_SIG		0x02014b50
+#define ZIP_CDIR_SIZE		46
+#define ZIP_LOCAL_SIZE		30
+#define ZIP_MAX_COMMENT		0xffff
+
+static int chunk_cmp(gconstpointer a, gconstpointer b)
+{
+	const struct srzip_chunk *ca, *cb;
+
+	ca = a;
+	cb = b;
+	if (ca->number < cb->number)
+		return -1;
+
+	return ca->number > cb->number;
+}
+
+static gchar *srzip_read_text(struct zip *archive, const char *name)
+{
+	struct zip_stat st;
+	struct zip_file *zf;
+	gchar *text;
+	zip_int64_t len;
+
+	if (zip_stat(archive, name, 0, &st) < 0)
+		return NULL;
+	if (!(zf = zip_fopen_index(archive, st.index, 0)))
+		return NULL;
+	text = g_malloc(st.size + 1);
+	len = zip_fread(zf, text, st.size);
+	zip_fclose(zf);
+	if (len < 0 || (zip_uint64_t)len != st.size) {
+		g_free(text);
+		return NULL;
+	}
+	text[len] = '\0';
+
+	return text;
+}
+
+static int srzip_read_metadata(struct srzip *zs, gchar **capturefile)
+{
+	GKeyFile *kf;
+	gchar *text, *val, **groups;
+	int ret, idx;
+
+	if (!(text = srzip_read_text(zs->archive, "metadata")))
+		return SR_ERR;
+	kf = g_key_file_new();
+	if (!g_key_file_load_from_data(kf, text, -1, 0, NULL)) {
+		g_key_file_free(kf);
+		g_free(text);
+		return SR_ERR;
+	}
+	g_free(text);
+
+	/* Only single device files with logic data only are handled. */
+	ret = SR_OK;
+	groups = g_key_file_get_groups(kf, NULL);
+	for (idx = 0; groups[idx]; idx++) {
+		if (g_str_has_prefix(groups[idx], "device ")
+				&& strcmp(groups[idx], "device 1") != 0)
+			ret = SR_ERR_NA;
+	}
+	g_strfreev(groups);
+	if (g_key_file_get_integer(kf, "device 1", "total analog", NULL) > 0)
+		ret = SR_ERR_NA;
+
+	*capturefile = g_key_file_get_string(kf, "device 1", "capturefile", NULL);
+	zs->unitsize = g_key_file_get_integer(kf, "device 1", "unitsize", NULL);
+	if (!*capturefile || !zs->unitsize)
+		ret = SR_ERR_NA;
+	if ((val = g_key_file_get_string(kf, "device 1", "samplerate", NULL))) {
+		if (sr_parse_sizestring(val, &zs->samplerate) != SR_OK)
+			zs->samplerate = 0;
+		g_free(val);
+	}
+	g_key_file_free(kf);
+
+	return ret;
+}
+
+/*
+ * Find the entries which hold the logic data: "<capturefile>-<n>", or
+ * just "<capturefile>" for the first chunk in old files.
+ */
+static void srzip_scan_chunks(struct srzip *zs, const char *capturefile)
+{
+	struct srzip_chunk chunk, *c;
+	struct zip_stat st;
+	zip_int64_t count, idx;
+	size_t len, pos;
+	const char *num;
+	char *end;
+
+	len = strlen(capturefile);
+	count = zip_get_num_entries(zs->archive, 0);
+	for (idx = 0; idx < count; idx++) {
+		if (zip_stat_index(zs->archive, idx, 0, &st) < 0)
+			continue;
+		if (strncmp(st.name, capturefile, len) != 0)
+			continue;
+		memset(&chunk, 0, sizeof(chunk));
+		if (st.name[len] == '\0') {
+			chunk.number = 1;
+		} else if (st.name[len] == '-' && g_ascii_isdigit(st.name[len + 1])) {
+			num = &st.name[len + 1];
+			chunk.number = g_ascii_strtoull(num, &end, 10);
+			if (*end)
+				continue;
+		} else {
+			continue;
+		}
+		chunk.index = st.index;
+		chunk.size = st.size;
+		chunk.comp_size = st.comp_size;
+		g_array_append_val(zs->chunks, chunk);
+	}
+	g_array_sort(zs->chunks, chunk_cmp);
+
+	zs->total_samples = 0;
+	for (pos = 0; pos < zs->chunks->len; pos++) {
+		c = &g_array_index(zs->chunks, struct srzip_chunk, pos);
+		c->first_sample = zs->total_samples;
+		c->samples = c->size / zs->unitsize;
+		zs->total_samples += c->samples;
+	}
+}
+
+static uint64_t rd_le(const uint8_t *p, size_t len)
+{
+	uint64_t val;
+
+	val = 0;
+	while (len--)
+		val = (val << 8) | p[len];
+
+	return val;
+}
+
+static gboolean read_at(FILE *f, uint64_t offset, void *buf, size_t len)
+{
+	if (fseeko(f, offset, SEEK_SET) != 0)
+		return FALSE;
+
+	return fread(buf, 1, len, f) == len;
+}
+
+/*
+ * Locate the central directory: the end of central directory record,
+ * and the Zip64 record which extends it for huge files.
+ */
+static gboolean zip_find_cdir(FILE *f, uint64_t *cdir_offset,
+	uint64_t *cdir_size)
+{
+	uint8_t *tail, rec[ZIP_EOCD64_SIZE];
+	const uint8_t *eocd, *loc;
+	uint64_t file_size, tail_len;
+	int64_t pos;
+
+	if (fseeko(f, 0, SEEK_END) != 0)
+		return FALSE;
+	file_size = ftello(f);
+	if (file_size < ZIP_EOCD_SIZE)
+		return FALSE;
+	tail_len = MIN(file_size,
+		ZIP_EOCD_SIZE + ZIP_EOCD64_LOC_SIZE + ZIP_MAX_COMMENT);
+	tail = g_malloc(tail_len);
+	if (!read_at(f, file_size - tail_len, tail, tail_len)) {
+		g_free(tail);
+		return FALSE;
+	}
+
+	eocd = NULL;
+	for (pos = tail_len - ZIP_EOCD_SIZE; pos >= 0; pos--) {
+		if (rd_le(&tail[pos], 4) == ZIP_EOCD_SIG) {
+			eocd = &tail[pos];
+			break;
+		}
+	}
+	if (!eocd) {
+		g_free(tail);
+		return FALSE;
+	}
+	*cdir_size = rd_le(eocd + 12, 4);
+	*cdir_offset = rd_le(eocd + 16, 4);
+
+	loc = pos >= ZIP_EOCD64_LOC_SIZE ? eocd - ZIP_EOCD64_LOC_SIZE : NULL;
+	if (loc && rd_le(loc, 4) == ZIP_EOCD64_LOC_SIG) {
+		if (!read_at(f, rd_le(loc + 8, 8), rec, sizeof(rec))
+				|| rd_le(rec, 4) != ZIP_EOCD64_SIG) {
+			g_free(tail);
+			return FALSE;
+		}
+		*cdir_size = rd_le(rec + 40, 8);
+		*cdir_offset = rd_le(rec + 48, 8);
+	}
+	g_free(tail);
+
+	return TRUE;
+}
+
+/*
+ * Get the offsets of the entries' compressed data. libzip doesn't tell,
+ * so the zip's central directory and local headers are read here. The
+ * central directory lists the entries in libzip's index order.
+ */
+static int srzip_scan_offsets(struct srzip *zs)
+{
+	struct srzip_chunk *chunk;
+	GArray *offsets;
+	FILE *f;
+	uint8_t *cdir, local[ZIP_LOCAL_SIZE];
+	const uint8_t *ent, *extra, *end;
+	uint64_t cdir_offset, cdir_size, offset;
+	size_t name_len, extra_len, comment_len, field_len, pos;
+	uint16_t field;
+	guint idx;
+	int ret;
+
+	if (!(f = g_fopen(zs->path, "rb")))
+		return SR_ERR;
+	if (!zip_find_cdir(f, &cdir_offset, &cdir_size)) {
+		fclose(f);
+		return SR_ERR;
+	}
+	cdir = g_malloc(cdir_size);
+	if (!read_at(f, cdir_offset, cdir, cdir_size)) {
+		g_free(cdir);
+		fclose(f);
+		return SR_ERR;
+	}
+
+	offsets = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+	ent = cdir;
+	end = cdir + cdir_size;
+	while (ent + ZIP_CDIR_SIZE <= end && rd_le(ent, 4) == ZIP_CDIR_SIG) {
+		name_len = rd_le(ent + 28, 2);
+		extra_len = rd_le(ent + 30, 2);
+		comment_len = rd_le(ent + 32, 2);
+		offset = rd_le(ent + 42, 4);
+		if (offset == 0xffffffff) {
+			/* Zip64 extra field, only present values are stored. */
+			extra = ent + ZIP_CDIR_SIZE + name_len;
+			for (pos = 0; pos + 4 <= extra_len; pos += 4 + field_len) {
+				field = rd_le(extra + pos, 2);
+				field_len = rd_le(extra + pos + 2, 2);
+				if (field != 0x0001)
+					continue;
+				field_len = 0;
+				if (rd_le(ent + 24, 4) == 0xffffffff)
+					field_len += 8;
+				if (rd_le(ent + 20, 4) == 0xffffffff)
+					field_len += 8;
+				offset = rd_le(extra + pos + 4 + field_len, 8);
+				break;
+			}
+		}
+		g_array_append_val(offsets, offset);
+		ent += ZIP_CDIR_SIZE + name_len + extra_len + comment_len;
+	}
+	g_free(cdir);
+
+	ret = SR_OK;
+	for (idx = 0; idx < zs->chunks->len; idx++) {
+		chunk = &g_array_index(zs->chunks, struct srzip_chunk, idx);
+		if (chunk->index >= offsets->len) {
+			ret = SR_ERR;
+			break;
+		}
+		offset = g_array_index(offsets, uint64_t, chunk->index);
+		if (!read_at(f, offset, local, sizeof(local))) {
+			ret = SR_ERR;
+			break;
+		}
+		chunk->offset = offset + ZIP_LOCAL_SIZE
+			+ rd_le(local + 26, 2) + rd_le(local + 28, 2);
+	}
+	g_array_free(offsets, TRUE);
+	fclose(f);
+
+	return ret;
+}
+
+/* Summarize which channels change within a chunk. */
+static void srzip_chunk_activity(struct srzip_chunk *chunk,
+	const uint8_t *buf, unsigned int unitsize)
+{
+	uint64_t idx, val, prev, toggles;
+
+	chunk->has_activity = FALSE;
+	if (unitsize > sizeof(uint64_t) || !chunk->samples)
+		return;
+
+	prev = rd_le(buf, unitsize);
+	chunk->first_value = prev;
+	toggles = 0;
+	for (idx = 1; idx < chunk->samples; idx++) {
+		val = rd_le(&buf[idx * unitsize], unitsize);
+		toggles |= val ^ prev;
+		prev = val;
+	}
+	chunk->last_value = prev;
+	chunk->toggles = toggles;
+	chunk->has_activity = TRUE;
+}
+
+static gchar *srzip_index_path(const struct srzip *zs)
+{
+	return g_strconcat(zs->path, INDEX_SUFFIX, NULL);
+}
+
+/* Load the index if it's there, and still matches the file. */
+static gboolean srzip_index_load(struct srzip *zs)
+{
+	struct srzip_chunk chunk;
+	gchar *path, *text, **lines, *line;
+	uint64_t size, samplerate, samples;
+	int64_t mtime;
+	unsigned int unitsize, version;
+	char toggles[20], first[20], last[20];
+	gboolean ok;
+	guint idx;
+
+	path = srzip_index_path(zs);
+	ok = g_file_get_contents(path, &text, NULL, NULL);
+	g_free(path);
+	if (!ok)
+		return FALSE;
+	lines = g_strsplit(text, "\n", 0);
+	g_free(text);
+
+	ok = lines[0] && sscanf(lines[0], INDEX_MAGIC " %u", &version) == 1
+		&& version == INDEX_VERSION;
+	samples = samplerate = unitsize = 0;
+	g_array_set_size(zs->chunks, 0);
+	for (idx = 1; ok && lines[idx]; idx++) {
+		line = lines[idx];
+		if (!*line)
+			continue;
+		if (g_str_has_prefix(line, "source ")) {
+			ok = sscanf(line, "source %" SCNu64 " %" SCNd64,
+				&size, &mtime) == 2 && size == zs->file_size
+				&& mtime == zs->file_mtime;
+		} else if (g_str_has_prefix(line, "samplerate ")) {
+			ok = sscanf(line, "samplerate %" SCNu64, &samplerate) == 1;
+		} else if (g_str_has_prefix(line, "unitsize ")) {
+			ok = sscanf(line, "unitsize %u", &unitsize) == 1
+				&& unitsize == zs->unitsize;
+		} else if (g_str_has_prefix(line, "samples ")) {
+			ok = sscanf(line, "samples %" SCNu64, &samples) == 1;
+		} else if (g_str_has_prefix(line, "chunk ")) {
+			memset(&chunk, 0, sizeof(chunk));
+			ok = sscanf(line, "chunk %" SCNu64 " %" SCNu64 " %" SCNu64
+				" %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64
+				" %19s %19s %19s", &chunk.number, &chunk.index,
+				&chunk.first_sample, &chunk.samples, &chunk.offset,
+				&chunk.size, &chunk.comp_size,
+				toggles, first, last) == 10;
+			if (ok && strcmp(toggles, "-") != 0) {
+				chunk.toggles = g_ascii_strtoull(toggles, NULL, 16);
+				chunk.first_value = g_ascii_strtoull(first, NULL, 16);
+				chunk.last_value = g_ascii_strtoull(last, NULL, 16);
+				chunk.has_activity = TRUE;
+			}
+			if (ok)
+				g_array_append_val(zs->chunks, chunk);
+		}
+	}
+	g_strfreev(lines);
+	if (!ok || !unitsize || !zs->chunks->len) {
+		g_array_set_size(zs->chunks, 0);
+		return FALSE;
+	}
+	zs->total_samples = samples;
+	if (!zs->samplerate)
+		zs->samplerate = samplerate;
+
+	return TRUE;
+}
+
+static void srzip_index_save(struct srzip *zs)
+{
+	const struct srzip_chunk *chunk;
+	GString *text;
+	GError *error;
+	gchar *path;
+	guint idx;
+
+	if (srzip_scan_offsets(zs) != SR_OK) {
+		g_debug("cli: Can't locate the chunks in %s.", zs->path);
+		return;
+	}
+
+	text = g_string_sized_new(128 + zs->chunks->len * 96);
+	g_string_append_printf(text, "%s %d\n", INDEX_MAGIC, INDEX_VERSION);
+	g_string_append_printf(text, "source %" PRIu64 " %" PRId64 "\n",
+		zs->file_size, zs->file_mtime);
+	g_string_append_printf(text, "samplerate %" PRIu64 "\n", zs->samplerate);
+	g_string_append_printf(text, "unitsize %u\n", zs->unitsize);
+	g_string_append_printf(text, "samples %" PRIu64 "\n", zs->total_samples);
+	for (idx = 0; idx < zs->chunks->len; idx++) {
+		chunk = &g_array_index(zs->chunks, struct srzip_chunk, idx);
+		g_string_append_printf(text, "chunk %" PRIu64 " %" PRIu64
+			" %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64
+			" %" PRIu64, chunk->number, chunk->index,
+			chunk->first_sample, chunk->samples, chunk->offset,
+			chunk->size, chunk->comp_size);
+		if (chunk->has_activity)
+			g_string_append_printf(text, " %" PRIx64 " %" PRIx64
+				" %" PRIx64 "\n", chunk->toggles,
+				chunk->first_value, chunk->last_value);
+		else
+			g_string_append(text, " - - -\n");
+	}
+
+	/* Not being able to store the index is not an error. */
+	path = srzip_index_path(zs);
+	error = NULL;
+	if (g_file_set_contents(path, text->str, text->len, &error)) {
+		zs->indexed = TRUE;
+		g_debug("cli: Stored index %s.", path);
+	} else {
+		g_debug("cli: Can't store index: %s.", error->message);
+		g_error_free(error);
+	}
+	g_free(path);
+	g_string_free(text, TRUE);
+}
+
+/*
+ * Open a session file for direct access. Returns SR_ERR_NA for session
+ * files which this code doesn't handle (the caller then uses libsigrok's
+ * session file support), or SR_ERR for files which aren't session files.
+ */
+int srzip_open(const char *path, struct srzip **out)
+{
+	struct srzip *zs;
+	GStatBuf st;
+	gchar *version, *capturefile;
+	int ret, err;
+
+	*out = NULL;
+	zs = g_malloc0(sizeof(*zs));
+	zs->path = g_strdup(path);
+	zs->chunks = g_array_new(FALSE, FALSE, sizeof(struct srzip_chunk));
+	if (!(zs->archive = zip_open(path, 0, &err))) {
+		srzip_close(zs);
+		return SR_ERR;
+	}
+
+	if (!(version = srzip_read_text(zs->archive, "version"))) {
+		srzip_close(zs);
+		return SR_ERR;
+	}
+	ret = SR_OK;
+	if (strcmp(g_strstrip(version), "1") != 0
+			&& strcmp(version, "2") != 0)
+		ret = SR_ERR_NA;
+	g_free(version);
+
+	if (g_stat(path, &st) == 0) {
+		zs->file_size = st.st_size;
+		zs->file_mtime = st.st_mtime;
+	}
+
+	capturefile = NULL;
+	if (ret == SR_OK)
+		ret = srzip_read_metadata(zs, &capturefile);
+	if (ret == SR_OK) {
+		zs->indexed = srzip_index_load(zs);
+		if (!zs->indexed)
+			srzip_scan_chunks(zs, capturefile);
+	}
+	g_free(capturefile);
+	if (ret != SR_OK) {
+		srzip_close(zs);
+		return ret;
+	}
+	g_debug("cli: Session file %s: %u chunks, %" PRIu64 " samples%s.",
+		path, zs->chunks->len, zs->total_samples,
+		zs->indexed ? " (indexed)" : "");
+	*out = zs;
+
+	return SR_OK;
+}
+
+void srzip_close(struct srzip *zs)
+{
+	if (!zs)
+		return;
+	if (zs->archive)
+		zip_discard(zs->archive);
+	g_array_free(zs->chunks, TRUE);
+	g_free(zs->path);
+	g_free(zs);
+}
+
+/*
+ * Decompress a chunk into the caller's buffer (which holds at least the
+ * chunk's size). The archive handle may differ from the one which was
+ * used to open the file, zip handles must not be shared across threads.
+ */
+int srzip_chunk_read(struct zip *archive, const struct srzip_chunk *chunk,
+	uint8_t *buf)
+{
+	struct zip_file *zf;
+	zip_int64_t len;
+
+	if (!(zf = zip_fopen_index(archive, chunk->index, 0)))
+		return SR_ERR;
+	len = zip_fread(zf, buf, chunk->size);
+	zip_fclose(zf);
+	if (len < 0 || (zip_uint64_t)len != chunk->size)
+		return SR_ERR;
+
+	return SR_OK;
+}
+
+static void srzip_send(const struct sr_dev_inst *sdi, struct df_arg_desc *df_arg,
+	uint16_t type, const void *payload)
+{
+	struct sr_datafeed_packet packet;
+
+	packet.type = type;
+	packet.payload = payload;
+	datafeed_in(sdi, &packet, df_arg);
+}
+
+/*
+ * Get the input properties without reading any sample data, the entry
+ * sizes determine the sample count.
+ */
+void srzip_props(struct srzip *zs, const struct sr_dev_inst *sdi,
+	struct df_arg_desc *df_arg)
+{
+	struct sr_datafeed_header header;
+
+	memset(&header, 0, sizeof(header));
+	header.feed_version = 1;
+	srzip_send(sdi, df_arg, SR_DF_HEADER, &header);
+	if (!df_arg->props.samplerate)
+		df_arg->props.samplerate = zs->samplerate;
+	df_arg->props.unitsize = zs->unitsize;
+	df_arg->props.sample_count_logic = zs->total_samples;
+	df_arg->props.counts_from = zs->indexed ?
+		"session file index" : "session file directory";
+	srzip_send(sdi, df_arg, SR_DF_END, NULL);
+}
+
+/*
+ * Chunks get inflated by a pool of threads while earlier chunks are
+ * being processed. libzip handles must not be shared across threads,
+ * every thread borrows one of a set of handles for the same file. The
+ * number of chunks which are inflated ahead is bounded by the number
+ * of buffer slots, chunks get delivered strictly in order.
+ */
+#define INFLATE_MAX_BUFFERED	(256 * 1024 * 1024)
+
+struct srzip_slot {
+	struct srzip_chunk *chunk;
+	uint8_t *buf;
+	int status;
+	gboolean done;
+};
+
+struct srzip_inflater {
+	struct srzip *zs;
+	GThreadPool *pool;
+	GAsyncQueue *archives;
+	GMutex mutex;
+	GCond cond;
+	struct srzip_slot *slots;
+	guint depth;
+	guint next_submit;
+	guint next_deliver;
+	guint end;
+};
+
+/* Share the processors among the files which get processed in parallel. */
+static guint srzip_threads(void)
+{
+	guint threads;
+
+	threads = g_get_num_processors() / MAX(opt_jobs, 1);
+
+	return MAX(threads, 1);
+}
+
+static void srzip_inflate(gpointer data, gpointer user_data)
+{
+	struct srzip_inflater *inf;
+	struct srzip_slot *slot;
+	struct zip *archive;
+	int status;
+
+	slot = data;
+	inf = user_data;
+	archive = g_async_queue_pop(inf->archives);
+	status = srzip_chunk_read(archive, slot->chunk, slot->buf);
+	g_async_queue_push(inf->archives, archive);
+	if (status == SR_OK && !inf->zs->indexed)
+		srzip_chunk_activity(slot->chunk, slot->buf, inf->zs->unitsize);
+
+	g_mutex_lock(&inf->mutex);
+	slot->status = status;
+	slot->done = TRUE;
+	g_cond_broadcast(&inf->cond);
+	g_mutex_unlock(&inf->mutex);
+}
+
+static void srzip_inflater_init(struct srzip_inflater *inf, struct srzip *zs,
+	guint first, guint end, uint64_t max_size)
+{
+	struct zip *archive;
+	guint threads, idx;
+	int err;
+
+	memset(inf, 0, sizeof(*inf));
+	inf->zs = zs;
+	inf->next_submit = inf->next_deliver = first;
+	inf->end = end;
+	inf->depth = 1;
+
+	threads = MIN(srzip_threads(), end - first);
+	if (threads > 1 && max_size)
+		inf->depth = MIN(2 * threads, INFLATE_MAX_BUFFERED / max_size);
+	if (inf->depth >= 2) {
+		inf->archives = g_async_queue_new();
+		for (idx = 0; idx < threads; idx++) {
+			if (!(archive = zip_open(zs->path, 0, &err)))
+				break;
+			g_async_queue_push(inf->archives, archive);
+		}
+		threads = idx;
+	}
+	if (inf->depth >= 2 && threads > 1) {
+		g_mutex_init(&inf->mutex);
+		g_cond_init(&inf->cond);
+		inf->pool = g_thread_pool_new(srzip_inflate, inf, threads,
+			TRUE, NULL);
+		g_debug("cli: Inflating with %u threads, up to %u chunks ahead.",
+			threads, inf->depth);
+	} else {
+		inf->depth = 1;
+	}
+
+	inf->slots = g_malloc0(inf->depth * sizeof(*inf->slots));
+	for (idx = 0; idx < inf->depth; idx++)
+		inf->slots[idx].buf = g_malloc(max_size ? max_size : 1);
+}
+
+static void srzip_inflater_free(struct srzip_inflater *inf)
+{
+	struct zip *archive;
+	guint idx;
+
+	if (inf->pool) {
+		/* Wait for chunks in flight, drop the queued ones. */
+		g_thread_pool_free(inf->pool, TRUE, TRUE);
+		g_mutex_clear(&inf->mutex);
+		g_cond_clear(&inf->cond);
+	}
+	if (inf->archives) {
+		while ((archive = g_async_queue_try_pop(inf->archives)))
+			zip_discard(archive);
+		g_async_queue_unref(inf->archives);
+	}
+	for (idx = 0; idx < inf->depth; idx++)
+		g_free(inf->slots[idx].buf);
+	g_free(inf->slots);
+}
+
+/*
+ * Get the next chunk's data, which stays valid until the next call.
+ * Returns NULL after the last chunk.
+ */
+static struct srzip_slot *srzip_inflater_next(struct srzip_inflater *inf)
+{
+	struct srzip_slot *slot;
+
+	if (inf->next_deliver >= inf->end)
+		return NULL;
+
+	if (!inf->pool) {
+		slot = &inf->slots[0];
+		slot->chunk = &g_array_index(inf->zs->chunks,
+			struct srzip_chunk, inf->next_deliver++);
+		slot->status = srzip_chunk_read(inf->zs->archive,
+			slot->chunk, slot->buf);
+		if (slot->status == SR_OK && !inf->zs->indexed)
+			srzip_chunk_activity(slot->chunk, slot->buf,
+				inf->zs->unitsize);
+		return slot;
+	}
+
+	/* Refill the slots, including the one which was delivered last. */
+	while (inf->next_submit < inf->end
+			&& inf->next_submit - inf->next_deliver < inf->depth) {
+		slot = &inf->slots[inf->next_submit % inf->depth];
+		slot->chunk = &g_array_index(inf->zs->chunks,
+			struct srzip_chunk, inf->next_submit);
+		slot->done = FALSE;
+		inf->next_submit++;
+		g_thread_pool_push(inf->pool, slot, NULL);
+	}
+
+	slot = &inf->slots[inf->next_deliver % inf->depth];
+	g_mutex_lock(&inf->mutex);
+	while (!slot->done)
+		g_cond_wait(&inf->cond, &inf->mutex);
+	g_mutex_unlock(&inf->mutex);
+	inf->next_deliver++;
+
+	return slot;
+}
+
+/*
+ * Send the session file's logic data to the datafeed callback. Chunks
+ * before the sample range are skipped, reading stops after the range.
+ * A complete pass over a file which has no index yet creates one.
+ */
+int srzip_feed(struct srzip *zs, const struct sr_dev_inst *sdi,
+	struct df_arg_desc *df_arg)
+{
+	struct sr_datafeed_header header;
+	struct sr_datafeed_logic logic;
+	struct srzip_inflater inf;
+	struct srzip_slot *slot;
+	struct srzip_chunk *chunk;
+	uint64_t from, to, max_size;
+	int64_t now;
+	guint idx, first, end;
+	int ret;
+
+	from = 0;
+	to = UINT64_MAX;
+	if (sample_window_active() && !df_arg->do_props
+			&& sample_window_range(zs->samplerate, &from, &to) != SR_OK)
+		return SR_ERR;
+
+	/* Determine the chunks which cover the range. */
+	first = end = 0;
+	max_size = 0;
+	for (idx = 0; idx < zs->chunks->len; idx++) {
+		chunk = &g_array_index(zs->chunks, struct srzip_chunk, idx);
+		if (chunk->first_sample + chunk->samples <= from) {
+			sample_window_skip(chunk->samples);
+			first = idx + 1;
+			continue;
+		}
+		if (chunk->first_sample >= to)
+			break;
+		max_size = MAX(max_size, chunk->size);
+	}
+	end = MAX(idx, first);
+	srzip_inflater_init(&inf, zs, first, end, max_size);
+
+	memset(&header, 0, sizeof(header));
+	header.feed_version = 1;
+	now = g_get_real_time();
+	header.starttime.tv_sec = now / G_USEC_PER_SEC;
+	header.starttime.tv_usec = now % G_USEC_PER_SEC;
+	srzip_send(sdi, df_arg, SR_DF_HEADER, &header);
+
+	ret = SR_OK;
+	while (!sample_window_done() && (slot = srzip_inflater_next(&inf))) {
+		if (slot->status != SR_OK) {
+			g_critical("Failed to read chunk %" PRIu64 " of %s.",
+				slot->chunk->number, zs->path);
+			ret = SR_ERR;
+			break;
+		}
+		logic.length = slot->chunk->size;
+		logic.unitsize = zs->unitsize;
+		logic.data = slot->buf;
+		srzip_send(sdi, df_arg, SR_DF_LOGIC, &logic);
+	}
+	srzip_send(sdi, df_arg, SR_DF_END, NULL);
+
+	if (ret == SR_OK && first == 0 && inf.next_deliver == zs->chunks->len
+			&& !zs->indexed)
+		srzip_index_save(zs);
+	srzip_inflater_free(&inf);
+
+	return ret;
+}
+#endif